@@ -0,0 +1,302 @@
+/** @file
+    @brief Header providing a compact binary columnar format for tracker
+   data, with a writer for converting once from CSV and a memory-mapped
+   reader.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_BinaryTracker_h_GUID_7D2E9B14_F6A0_4C85_93E1_B08C5A27D3F6
+#define INCLUDED_BinaryTracker_h_GUID_7D2E9B14_F6A0_4C85_93E1_B08C5A27D3F6
+
+// Internal Includes
+#include "MappedFile.h"
+#include "TrackerSource.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace motionsynth {
+namespace binary_tracker {
+
+    /// Layout: a Header at offset 0, then one array per column, each
+    /// starting at a COLUMN_ALIGNMENT-aligned offset given in the header:
+    /// int64 microsecond timestamps, then doubles x, y, z, qw, qx, qy, qz.
+    /// Everything is in the writer's byte order, which the reader checks.
+    enum Column { Timestamp, X, Y, Z, QW, QX, QY, QZ, NUM_COLUMNS };
+
+    static const char MAGIC[8] = {'M', 'S', 'T', 'R', 'A', 'C', 'K', '\0'};
+    static const std::uint32_t FORMAT_VERSION = 1;
+    static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static const std::uint64_t COLUMN_ALIGNMENT = 64;
+    /// All columns have 8-byte elements.
+    static const std::uint64_t ELEMENT_SIZE = 8;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrderMark;
+        std::uint64_t sampleCount;
+        std::int64_t firstTimestampUsec;
+        std::int64_t lastTimestampUsec;
+        std::uint64_t columnOffsets[NUM_COLUMNS];
+    };
+    static_assert(std::is_standard_layout<Header>::value,
+                  "Header is written to disk as-is");
+
+    /// True if the named file starts with our magic number.
+    inline bool isBinaryTrackerFile(std::string const &fn) {
+        std::ifstream is(fn, std::ios::binary);
+        char magic[sizeof(MAGIC)];
+        return is.read(magic, sizeof(magic)) &&
+               0 == std::memcmp(magic, MAGIC, sizeof(MAGIC));
+    }
+
+    /// Writes a binary tracker file for up to capacity samples, buffering a
+    /// chunk of each column at a time. The header is written by finish().
+    class Writer {
+      public:
+        static const std::size_t CHUNK_SAMPLES = 64 * 1024;
+
+        Writer(std::string const &fn, std::uint64_t capacity)
+            : os_(fn, std::ios::binary | std::ios::trunc),
+              capacity_(capacity) {
+            std::memset(&header_, 0, sizeof(header_));
+            std::memcpy(header_.magic, MAGIC, sizeof(MAGIC));
+            header_.version = FORMAT_VERSION;
+            header_.byteOrderMark = BYTE_ORDER_MARK;
+            auto offset = alignUp(sizeof(Header));
+            for (auto &colOffset : header_.columnOffsets) {
+                colOffset = offset;
+                offset = alignUp(offset + capacity * ELEMENT_SIZE);
+            }
+            timestamps_.reserve(CHUNK_SAMPLES);
+            for (auto &col : columns_) {
+                col.reserve(CHUNK_SAMPLES);
+            }
+        }
+
+        explicit operator bool() const { return static_cast<bool>(os_); }
+
+        /// Returns false if already at capacity. The file keeps whole
+        /// microseconds, so anything finer is rounded down.
+        bool append(Nanoseconds t, Eigen::Vector3d const &xlate,
+                    Eigen::Quaterniond const &rot) {
+            if (header_.sampleCount + timestamps_.size() >= capacity_) {
+                return false;
+            }
+            auto usec = toMicroseconds(t);
+            if (header_.sampleCount == 0 && timestamps_.empty()) {
+                header_.firstTimestampUsec = usec;
+            }
+            header_.lastTimestampUsec = usec;
+            timestamps_.push_back(usec);
+            columns_[X - 1].push_back(xlate.x());
+            columns_[Y - 1].push_back(xlate.y());
+            columns_[Z - 1].push_back(xlate.z());
+            columns_[QW - 1].push_back(rot.w());
+            columns_[QX - 1].push_back(rot.x());
+            columns_[QY - 1].push_back(rot.y());
+            columns_[QZ - 1].push_back(rot.z());
+            if (timestamps_.size() == CHUNK_SAMPLES) {
+                flushChunk();
+            }
+            return true;
+        }
+
+        /// Writes out remaining data and the header.
+        bool finish() {
+            flushChunk();
+            os_.seekp(0);
+            os_.write(reinterpret_cast<const char *>(&header_),
+                      sizeof(header_));
+            os_.flush();
+            return static_cast<bool>(os_);
+        }
+
+        std::uint64_t sampleCount() const {
+            return header_.sampleCount + timestamps_.size();
+        }
+
+      private:
+        static std::uint64_t alignUp(std::uint64_t offset) {
+            return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT *
+                   COLUMN_ALIGNMENT;
+        }
+        template <typename T>
+        void writeColumnChunk(Column col, std::vector<T> &data) {
+            const auto offset = header_.columnOffsets[col] +
+                                header_.sampleCount * ELEMENT_SIZE;
+            os_.seekp(static_cast<std::streamoff>(offset));
+            os_.write(reinterpret_cast<const char *>(data.data()),
+                      static_cast<std::streamsize>(data.size() * sizeof(T)));
+            data.clear();
+        }
+        void flushChunk() {
+            if (timestamps_.empty()) {
+                return;
+            }
+            auto n = timestamps_.size();
+            writeColumnChunk(Timestamp, timestamps_);
+            for (int col = X; col < NUM_COLUMNS; ++col) {
+                writeColumnChunk(static_cast<Column>(col), columns_[col - 1]);
+            }
+            header_.sampleCount += n;
+        }
+
+        std::ofstream os_;
+        std::uint64_t capacity_;
+        Header header_;
+        std::vector<std::int64_t> timestamps_;
+        std::vector<double> columns_[NUM_COLUMNS - 1];
+    };
+
+    /// Maps a binary tracker file and gives access to its columns.
+    class File {
+      public:
+        /// Maps and validates the named file. On failure, returns false
+        /// with a description in error.
+        bool open(std::string const &fn, std::string &error,
+                  csvtools::MapHints hints = csvtools::MapHints()) {
+            if (!file_.open(fn, hints)) {
+                error = "could not map the file";
+                return false;
+            }
+            if (file_.size() < sizeof(Header)) {
+                error = "file too small for a header";
+                return false;
+            }
+            std::memcpy(&header_, file_.data(), sizeof(header_));
+            if (0 != std::memcmp(header_.magic, MAGIC, sizeof(MAGIC))) {
+                error = "not a binary tracker file";
+                return false;
+            }
+            if (header_.byteOrderMark != BYTE_ORDER_MARK) {
+                error = "written with a different byte order";
+                return false;
+            }
+            if (header_.version != FORMAT_VERSION) {
+                error = "unsupported format version";
+                return false;
+            }
+            const auto n = header_.sampleCount;
+            if (n > file_.size() / ELEMENT_SIZE) {
+                error = "sample count exceeds file size";
+                return false;
+            }
+            for (auto offset : header_.columnOffsets) {
+                if (offset % COLUMN_ALIGNMENT != 0 || offset > file_.size() ||
+                    n * ELEMENT_SIZE > file_.size() - offset) {
+                    error = "column outside of the file";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        Header const &header() const { return header_; }
+        std::uint64_t sampleCount() const { return header_.sampleCount; }
+        const std::int64_t *timestamps() const {
+            return reinterpret_cast<const std::int64_t *>(
+                file_.data() + header_.columnOffsets[Timestamp]);
+        }
+        const double *column(Column col) const {
+            return reinterpret_cast<const double *>(
+                file_.data() + header_.columnOffsets[col]);
+        }
+
+      private:
+        csvtools::MappedFile file_;
+        Header header_;
+    };
+
+} // namespace binary_tracker
+
+/// Poses read in order straight out of a mapped binary tracker file.
+class BinaryTrackerSource : public TrackerSource {
+  public:
+    explicit BinaryTrackerSource(binary_tracker::File const &file)
+        : n_(file.sampleCount()), t_(file.timestamps()) {
+        using namespace binary_tracker;
+        for (int col = X; col < NUM_COLUMNS; ++col) {
+            cols_[col] = file.column(static_cast<Column>(col));
+        }
+    }
+
+    bool readTimestamp(Nanoseconds &t) override {
+        if (i_ >= n_) {
+            return false;
+        }
+        t = t_[i_] * NANOSECONDS_PER_MICROSECOND;
+        ++i_;
+        recent_ = std::min<std::uint64_t>(recent_ + 1, 2);
+        return true;
+    }
+
+    bool decodePose(Recent which, Eigen::Vector3d &xlate,
+                    Eigen::Quaterniond &rot) override {
+        using namespace binary_tracker;
+        const std::uint64_t back = which == Recent::Last ? 1 : 2;
+        if (recent_ < back) {
+            return false;
+        }
+        const auto i = i_ - back;
+        xlate = Eigen::Vector3d(cols_[X][i], cols_[Y][i], cols_[Z][i]);
+        rot = Eigen::Quaterniond(cols_[QW][i], cols_[QX][i], cols_[QY][i],
+                                 cols_[QZ][i]);
+        return true;
+    }
+
+    bool seek(Nanoseconds t) override {
+        auto after = std::upper_bound(t_, t_ + n_, toMicroseconds(t));
+        std::uint64_t i = after == t_ ? 0 : (after - t_) - 1;
+        /// Not the last sample, if there's one before it.
+        if (n_ > 1 && i + 1 >= n_) {
+            i = n_ - 2;
+        }
+        i_ = i;
+        recent_ = 0;
+        return true;
+    }
+
+  private:
+    std::uint64_t n_;
+    const std::int64_t *t_;
+    const double *cols_[binary_tracker::NUM_COLUMNS] = {};
+    std::uint64_t i_ = 0;
+    /// Samples read since the start or the last seek, up to 2.
+    std::uint64_t recent_ = 0;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_BinaryTracker_h_GUID_7D2E9B14_F6A0_4C85_93E1_B08C5A27D3F6
@@ -0,0 +1,178 @@
+/** @file
+    @brief Header providing an output file sink with a large user-space buffer
+   and explicit flushing, as a replacement for per-row std::endl on an
+   ofstream.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_BufferedWriter_h_GUID_0B93E5D7_C2F4_4A18_9D6E_73A58B1F24C6
+#define INCLUDED_BufferedWriter_h_GUID_0B93E5D7_C2F4_4A18_9D6E_73A58B1F24C6
+
+// Internal Includes
+#include "CSVTools.h"
+#include "Instrumentation.h"
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace csvtools {
+
+/// Writes to a file through one big buffer that only goes to the OS when it
+/// fills up or flush() is called, so each flush is a single write call.
+/// Keeps track of how much it has written and how often it flushed.
+class BufferedWriter {
+  public:
+    static const std::size_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    explicit BufferedWriter(std::string const &fn,
+                            std::size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : file_(std::fopen(fn.c_str(), "wb")),
+          buf_(bufferSize > 0 ? bufferSize : 1) {
+        if (file_) {
+            // We are the buffer: don't let stdio add another copy.
+            std::setvbuf(file_, nullptr, _IONBF, 0);
+        }
+    }
+    ~BufferedWriter() {
+        if (file_) {
+            flush();
+            std::fclose(file_);
+        }
+    }
+    BufferedWriter(BufferedWriter const &) = delete;
+    BufferedWriter &operator=(BufferedWriter const &) = delete;
+
+    /// False if the file couldn't be opened or a write failed.
+    explicit operator bool() const { return file_ && !failed_; }
+
+    void write(const char *data, std::size_t len) {
+        if (len > buf_.size() - used_) {
+            flush();
+            if (len >= buf_.size()) {
+                // bigger than the whole buffer: no point in copying it.
+                writeOut(data, len);
+                return;
+            }
+        }
+        std::memcpy(buf_.data() + used_, data, len);
+        used_ += len;
+    }
+    void write(StringRef str) { write(str.data(), str.size()); }
+    void put(char c) {
+        if (used_ == buf_.size()) {
+            flush();
+        }
+        buf_[used_++] = c;
+    }
+
+    /// Makes room for at least n bytes and returns where to put them, for
+    /// formatting directly into the buffer. Follow up with commit().
+    char *prepare(std::size_t n) {
+        if (n > buf_.size() - used_) {
+            flush();
+            if (n > buf_.size()) {
+                buf_.resize(n);
+            }
+        }
+        return buf_.data() + used_;
+    }
+    /// Marks n bytes written after a call to prepare() as used.
+    void commit(std::size_t n) { used_ += n; }
+
+    /// Hands the buffered data to the OS. Also called when the buffer is full
+    /// and on destruction.
+    void flush() {
+        if (used_ > 0) {
+            writeOut(buf_.data(), used_);
+            used_ = 0;
+        }
+    }
+
+    /// @name Statistics
+    /// @{
+    /// Bytes actually handed to the OS so far.
+    std::uint64_t bytesWritten() const { return bytesWritten_; }
+    /// Number of write calls made so far.
+    std::uint64_t flushCount() const { return flushCount_; }
+    std::size_t bufferSize() const { return buf_.size(); }
+    /// @}
+
+  private:
+    void writeOut(const char *data, std::size_t len) {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(OutputWriting);
+        if (!file_ || failed_) {
+            return;
+        }
+        auto written = std::fwrite(data, 1, len, file_);
+        bytesWritten_ += written;
+        flushCount_++;
+        if (written != len) {
+            failed_ = true;
+        }
+    }
+    std::FILE *file_;
+    std::vector<char> buf_;
+    std::size_t used_ = 0;
+    bool failed_ = false;
+    std::uint64_t bytesWritten_ = 0;
+    std::uint64_t flushCount_ = 0;
+};
+
+/// Same interface for writing as BufferedWriter, but it all just stays in
+/// memory, for output that's put together out of order and written later.
+class MemoryWriter {
+  public:
+    void write(const char *data, std::size_t len) {
+        buf_.insert(buf_.end(), data, data + len);
+    }
+    void write(StringRef str) { write(str.data(), str.size()); }
+    void put(char c) { buf_.push_back(c); }
+
+    char *prepare(std::size_t n) {
+        prepared_ = buf_.size();
+        buf_.resize(prepared_ + n);
+        return buf_.data() + prepared_;
+    }
+    void commit(std::size_t n) { buf_.resize(prepared_ + n); }
+
+    const char *data() const { return buf_.data(); }
+    std::size_t size() const { return buf_.size(); }
+    /// Frees the memory as well as emptying it.
+    void clear() { std::vector<char>().swap(buf_); }
+
+  private:
+    std::vector<char> buf_;
+    /// Where the room handed out by the last prepare() starts.
+    std::size_t prepared_ = 0;
+};
+
+} // namespace csvtools
+
+#endif // INCLUDED_BufferedWriter_h_GUID_0B93E5D7_C2F4_4A18_9D6E_73A58B1F24C6
@@ -0,0 +1,171 @@
+/** @file
+    @brief Header providing vectorized classification of CSV text into
+   bitmasks of commas, newlines and double quotes, 64 bytes at a time.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_CSVScanner_h_GUID_E4B0C8F2_17A9_4D36_8C5B_9F2E61D7A043
+#define INCLUDED_CSVScanner_h_GUID_E4B0C8F2_17A9_4D36_8C5B_9F2E61D7A043
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+#if defined(__AVX2__)
+#define CSVTOOLS_SCANNER_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) ||                                 \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSVTOOLS_SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Standard includes
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace csvtools {
+namespace scanner {
+
+    /// Number of bytes classified at once: one bit per byte in a uint64.
+    static const std::size_t BLOCK_SIZE = 64;
+
+    /// Bit i set means byte i of the block is that character.
+    struct BlockMasks {
+        std::uint64_t comma;
+        std::uint64_t newline;
+        std::uint64_t quote;
+    };
+
+    /// Classifies exactly BLOCK_SIZE readable bytes starting at p.
+    inline BlockMasks classifyBlock(const char *p) {
+        BlockMasks ret;
+#if defined(CSVTOOLS_SCANNER_AVX2)
+        const __m256i commas = _mm256_set1_epi8(',');
+        const __m256i newlines = _mm256_set1_epi8('\n');
+        const __m256i quotes = _mm256_set1_epi8('"');
+        const __m256i lo =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i hi =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+        auto mask = [&](__m256i needle) {
+            auto l = static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)));
+            auto h = static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)));
+            return std::uint64_t(l) | (std::uint64_t(h) << 32);
+        };
+        ret.comma = mask(commas);
+        ret.newline = mask(newlines);
+        ret.quote = mask(quotes);
+#elif defined(CSVTOOLS_SCANNER_SSE2)
+        const __m128i commas = _mm_set1_epi8(',');
+        const __m128i newlines = _mm_set1_epi8('\n');
+        const __m128i quotes = _mm_set1_epi8('"');
+        __m128i chunks[4];
+        for (int i = 0; i < 4; ++i) {
+            chunks[i] =
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        }
+        auto mask = [&](__m128i needle) {
+            std::uint64_t ret = 0;
+            for (int i = 0; i < 4; ++i) {
+                auto bits = static_cast<std::uint32_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(chunks[i], needle)));
+                ret |= std::uint64_t(bits) << (16 * i);
+            }
+            return ret;
+        };
+        ret.comma = mask(commas);
+        ret.newline = mask(newlines);
+        ret.quote = mask(quotes);
+#else
+        ret.comma = ret.newline = ret.quote = 0;
+        for (std::size_t i = 0; i < BLOCK_SIZE; ++i) {
+            const std::uint64_t bit = std::uint64_t(1) << i;
+            switch (p[i]) {
+            case ',':
+                ret.comma |= bit;
+                break;
+            case '\n':
+                ret.newline |= bit;
+                break;
+            case '"':
+                ret.quote |= bit;
+                break;
+            default:
+                break;
+            }
+        }
+#endif
+        return ret;
+    }
+
+    /// Classifies the n < BLOCK_SIZE bytes at p, which may be right up
+    /// against the end of a mapping, so are copied out before the wide loads.
+    inline BlockMasks classifyBlock(const char *p, std::size_t n) {
+        char buf[BLOCK_SIZE] = {0};
+        std::memcpy(buf, p, n);
+        return classifyBlock(buf);
+    }
+
+    /// Turns a mask of quote characters into a mask of bytes inside quotes
+    /// (including the opening quote), by a running XOR from the low bit up.
+    inline std::uint64_t prefixXor(std::uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    /// Index of the lowest set bit: bits must be nonzero.
+    inline unsigned lowestBitIndex(std::uint64_t bits) {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward64(&idx, bits);
+        return static_cast<unsigned>(idx);
+#else
+        return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+    }
+
+    inline std::uint64_t clearLowestBit(std::uint64_t bits) {
+        return bits & (bits - 1);
+    }
+
+    /// Mask of the bits strictly below bit n.
+    inline std::uint64_t bitsBelow(unsigned n) {
+        return n == 0 ? 0 : (~std::uint64_t(0) >> (64 - n));
+    }
+
+} // namespace scanner
+} // namespace csvtools
+
+#endif // INCLUDED_CSVScanner_h_GUID_E4B0C8F2_17A9_4D36_8C5B_9F2E61D7A043
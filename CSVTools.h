@@ -26,14 +26,17 @@
 #define INCLUDED_CSVTools_h_GUID_82FA298C_196A_46AA_B2D6_059F2A035687
 
 // Internal Includes
-// - none
+#include "CSVScanner.h"
 
 // Library/third-party includes
 // - none
 
 // Standard includes
 #include <cstddef>
-#include <iosfwd>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -43,12 +46,76 @@ static const char COMMA_CHAR = ',';
 
 static const char DOUBLEQUOTE_CHAR = '"';
 
+/// A non-owning view of a run of characters - a line or a field within some
+/// buffer (a std::string, a memory-mapped file...) that must outlive it.
+class StringRef {
+  public:
+    StringRef() = default;
+    StringRef(const char *data, std::size_t size) : data_(data), size_(size) {}
+    StringRef(std::string const &str) : data_(str.data()), size_(str.size()) {}
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return 0 == size_; }
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    char front() const { return data_[0]; }
+    char back() const { return data_[size_ - 1]; }
+    char operator[](std::size_t i) const { return data_[i]; }
+
+    /// Sub-range, clamped to the end of the view like std::string::substr.
+    StringRef substr(std::size_t pos,
+                     std::size_t len = std::string::npos) const {
+        if (pos > size_) {
+            pos = size_;
+        }
+        if (len > size_ - pos) {
+            len = size_ - pos;
+        }
+        return StringRef(data_ + pos, len);
+    }
+
+    std::string str() const { return std::string(data_, size_); }
+
+  private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+inline bool operator==(StringRef const &a, StringRef const &b) {
+    return a.size() == b.size() &&
+           (a.empty() || 0 == std::memcmp(a.data(), b.data(), a.size()));
+}
+inline bool operator!=(StringRef const &a, StringRef const &b) {
+    return !(a == b);
+}
+inline std::ostream &operator<<(std::ostream &os, StringRef const &str) {
+    os.write(str.data(), static_cast<std::streamsize>(str.size()));
+    return os;
+}
+
+/// Trims trailing newline characters off a view of a line.
+inline StringRef trimLineEnding(StringRef line) {
+    auto n = line.size();
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+        --n;
+    }
+    return line.substr(0, n);
+}
+
+/// Reads a line into a caller-provided buffer, reusing its capacity, and
+/// strips the line ending. Returns the stream state like std::getline.
+inline std::istream &getCleanLine(std::istream &is, std::string &line) {
+    std::getline(is, line);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+        line.pop_back();
+    }
+    return is;
+}
+
 inline std::string getCleanLine(std::istream &is) {
     std::string ret;
-    std::getline(is, ret);
-    while (!ret.empty() && (ret.back() == '\n' || ret.back() == '\r')) {
-        ret.pop_back();
-    }
+    getCleanLine(is, ret);
     return ret;
 }
 
@@ -78,34 +145,135 @@ namespace string_fields {
     }
 }
 
-std::vector<std::string> getFields(std::string const &line,
-                                   std::size_t numFields,
-                                   std::size_t first = 0) {
-    std::vector<std::string> ret;
-    /// "begin" iterator/position
-    std::size_t b = string_fields::getBeginningOfField(line, first);
-    /// initial "one past the end" iterator/position
-    auto e = b;
-    std::size_t len = 0;
-    bool done = false;
-    const auto n = line.size();
-    /// the condition on b < n is because we update b = e + 1, and e might be
-    /// the last character in the string.
-    for (std::size_t i = 0; i < numFields && !done && b < n; ++i) {
-        e = line.find(COMMA_CHAR, b);
-        if (e == std::string::npos) {
-            // indicate to substring we want the rest of the line.
-            len = std::string::npos;
-            // quit after this field
-            done = true;
-        } else {
-            len = e - b;
-        }
+/// Location of a single field as an offset/length pair into its line.
+struct FieldSpan {
+    std::size_t offset;
+    std::size_t length;
+};
+
+/// Reusable container for the field locations of one line: clearing it keeps
+/// its storage, so tokenizing row after row into the same object does not
+/// allocate once it has grown to the widest row.
+class FieldSpans {
+  public:
+    std::size_t size() const { return spans_.size(); }
+    bool empty() const { return spans_.empty(); }
+    void clear() { spans_.clear(); }
+    void reserve(std::size_t n) { spans_.reserve(n); }
+    void push_back(FieldSpan span) { spans_.push_back(span); }
+    FieldSpan const &operator[](std::size_t i) const { return spans_[i]; }
 
-        ret.emplace_back(line.substr(b, len));
-        if (!done) {
-            b = e + 1;
+    /// Gets a view of field i within the line that was tokenized.
+    StringRef view(StringRef line, std::size_t i) const {
+        return StringRef(line.data() + spans_[i].offset, spans_[i].length);
+    }
+
+  private:
+    std::vector<FieldSpan> spans_;
+};
+
+namespace string_fields {
+    /// Shared by getFieldSpans and scanRow: walks [begin, end) a block at a
+    /// time with the vectorized classifier, recording fields split at commas
+    /// that are not inside double quotes. If stopAtLine, stops at the first
+    /// newline and returns its offset; otherwise stops as soon as numFields
+    /// fields are found. Returns end - begin if no newline was seen.
+    inline std::size_t scanFields(const char *begin, const char *end,
+                                  std::size_t numFields, FieldSpans &spans,
+                                  std::size_t first, bool stopAtLine) {
+        using namespace scanner;
+        spans.clear();
+        const auto total = static_cast<std::size_t>(end - begin);
+        /// commas still to skip to get to field "first"
+        std::size_t skip = first;
+        /// "begin" position of the current field
+        std::size_t b = 0;
+        bool wantFields = numFields > 0;
+        std::size_t lineEnd = total;
+        /// all ones if the previous block ended inside quotes
+        std::uint64_t quoteCarry = 0;
+        for (std::size_t blockStart = 0; blockStart < total;
+             blockStart += BLOCK_SIZE) {
+            if (!wantFields && !stopAtLine) {
+                return total;
+            }
+            const auto remaining = total - blockStart;
+            const auto masks =
+                remaining >= BLOCK_SIZE
+                    ? classifyBlock(begin + blockStart)
+                    : classifyBlock(begin + blockStart, remaining);
+            if (!wantFields && !masks.newline) {
+                continue;
+            }
+            const auto inQuotes = prefixXor(masks.quote) ^ quoteCarry;
+            quoteCarry = 0 - (inQuotes >> 63);
+            auto commas = masks.comma & ~inQuotes;
+            if (stopAtLine && masks.newline) {
+                const auto nl = lowestBitIndex(masks.newline);
+                lineEnd = blockStart + nl;
+                commas &= bitsBelow(nl);
+            }
+            for (; commas && wantFields; commas = clearLowestBit(commas)) {
+                const auto e = blockStart + lowestBitIndex(commas);
+                if (skip > 0) {
+                    // As in getBeginningOfField, a leading comma doesn't
+                    // count when looking for a later field.
+                    if (e != 0) {
+                        --skip;
+                        b = e + 1;
+                    }
+                    continue;
+                }
+                spans.push_back(FieldSpan{b, e - b});
+                b = e + 1;
+                wantFields = spans.size() < numFields;
+            }
+            if (lineEnd != total) {
+                break;
+            }
         }
+        /// the rest of the line is the last field, if there's anything there.
+        if (wantFields && 0 == skip) {
+            const auto n = trimLineEnding(StringRef(begin, lineEnd)).size();
+            if (b < n) {
+                spans.push_back(FieldSpan{b, n - b});
+            }
+        }
+        return lineEnd;
+    }
+} // namespace string_fields
+
+/// Non-allocating counterpart to getFields: locates up to numFields fields
+/// (starting at field index first) without copying them out of the line.
+/// Commas inside double quotes do not split fields. Returns the number of
+/// fields found.
+inline std::size_t getFieldSpans(StringRef line, std::size_t numFields,
+                                 FieldSpans &spans, std::size_t first = 0) {
+    string_fields::scanFields(line.begin(), line.end(), numFields, spans,
+                              first, false);
+    return spans.size();
+}
+
+/// One pass over a buffer for a whole row: finds the end of the line starting
+/// at begin and the spans of up to numFields of its fields, like getFieldSpans
+/// would on the cleaned line. Returns the offset of the terminating newline,
+/// or end - begin if there is none.
+inline std::size_t scanRow(const char *begin, const char *end,
+                           std::size_t numFields, FieldSpans &spans,
+                           std::size_t first = 0) {
+    return string_fields::scanFields(begin, end, numFields, spans, first,
+                                     true);
+}
+
+inline std::vector<std::string> getFields(StringRef line,
+                                          std::size_t numFields,
+                                          std::size_t first = 0) {
+    FieldSpans spans;
+    getFieldSpans(line, numFields, spans, first);
+    std::vector<std::string> ret;
+    ret.reserve(spans.size());
+    for (std::size_t i = 0; i < spans.size(); ++i) {
+        ret.emplace_back(spans.view(line, i).str());
     }
     return ret;
 }
@@ -120,6 +288,14 @@ inline void stripQuotes(std::string &field) {
     }
 }
 
+inline StringRef stripQuotes(StringRef field) {
+    if (field.size() > 1 && field.front() == DOUBLEQUOTE_CHAR &&
+        field.back() == DOUBLEQUOTE_CHAR) {
+        return field.substr(1, field.size() - 2);
+    }
+    return field;
+}
+
 inline void stripQuotes(std::vector<std::string> &fields) {
     for (auto &field : fields) {
         stripQuotes(field);
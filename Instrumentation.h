@@ -0,0 +1,286 @@
+/** @file
+    @brief Header providing lightweight timing of the hot path's stages and a
+   summary of where the time went. Only compiled in with
+   MOTION_SYNTHESIZER_INSTRUMENT defined; otherwise the macros expand to
+   nothing.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_Instrumentation_h_GUID_B022046E_F55A_43AA_B905_D624F98E27C6
+#define INCLUDED_Instrumentation_h_GUID_B022046E_F55A_43AA_B905_D624F98E27C6
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+#ifdef MOTION_SYNTHESIZER_INSTRUMENT
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MOTIONSYNTH_INSTRUMENT_TSC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define MOTIONSYNTH_INSTRUMENT_TSC
+#include <x86intrin.h>
+#endif
+#endif
+
+// Standard includes
+#include <ostream>
+
+#ifdef MOTION_SYNTHESIZER_INSTRUMENT
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace instrument {
+
+/// Stages of the hot path that get timed. Time spent in a stage nested in
+/// another only counts for the inner one.
+enum class Stage {
+    LineReading,
+    FieldSplitting,
+    NumericParsing,
+    TrackerAdvancing,
+    Interpolation,
+    OutputFormatting,
+    OutputWriting,
+    NUM_STAGES
+};
+
+/// Things that get counted.
+enum class Counter {
+    /// Reference rows read.
+    ReferenceRows,
+    /// Bytes of input handed out by line sources.
+    InputBytes,
+    /// Interpolation queries answered.
+    Queries,
+    /// Times a sequential engine moved on to the next tracker interval.
+    TrackerAdvances,
+    NUM_COUNTERS
+};
+
+#ifdef MOTION_SYNTHESIZER_INSTRUMENT
+
+static const std::size_t NUM_STAGES =
+    static_cast<std::size_t>(Stage::NUM_STAGES);
+static const std::size_t NUM_COUNTERS =
+    static_cast<std::size_t>(Counter::NUM_COUNTERS);
+
+/// Cheapest monotonic tick count there is: the time stamp counter on x86,
+/// steady_clock elsewhere.
+inline std::uint64_t ticks() {
+#ifdef MOTIONSYNTH_INSTRUMENT_TSC
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/// One thread's totals. Only that thread writes them.
+struct ThreadCounters {
+    /// Self time per stage, in ticks. Nested stages subtract from their
+    /// parent, so these only add up right once every scope has closed.
+    std::uint64_t ticks[NUM_STAGES] = {};
+    std::uint64_t calls[NUM_STAGES] = {};
+    std::uint64_t counts[NUM_COUNTERS] = {};
+    /// Innermost stage being timed, or NUM_STAGES for none.
+    std::size_t current = NUM_STAGES;
+};
+
+/// Every thread's counters, kept past the end of the thread, along with
+/// what's needed to turn ticks into seconds.
+class Registry {
+  public:
+    Registry()
+        : startTime_(std::chrono::steady_clock::now()), startTicks_(ticks()) {
+    }
+
+    std::shared_ptr<ThreadCounters> add() {
+        std::shared_ptr<ThreadCounters> ret(new ThreadCounters);
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(ret);
+        return ret;
+    }
+
+    /// Sums of all threads' counters so far. Meant for when the other
+    /// threads are done.
+    ThreadCounters total() {
+        ThreadCounters ret;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const &t : threads_) {
+            for (std::size_t i = 0; i < NUM_STAGES; ++i) {
+                ret.ticks[i] += t->ticks[i];
+                ret.calls[i] += t->calls[i];
+            }
+            for (std::size_t i = 0; i < NUM_COUNTERS; ++i) {
+                ret.counts[i] += t->counts[i];
+            }
+        }
+        return ret;
+    }
+
+    /// Seconds since the registry was made, and ticks per second over
+    /// that time.
+    void elapsed(double &seconds, double &ticksPerSecond) const {
+        seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - startTime_)
+                      .count();
+        ticksPerSecond =
+            seconds > 0 ? static_cast<double>(ticks() - startTicks_) / seconds
+                        : 1.;
+    }
+
+  private:
+    std::chrono::steady_clock::time_point startTime_;
+    std::uint64_t startTicks_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadCounters>> threads_;
+};
+
+inline Registry &registry() {
+    static Registry r;
+    return r;
+}
+
+inline ThreadCounters &local() {
+    thread_local std::shared_ptr<ThreadCounters> mine = registry().add();
+    return *mine;
+}
+
+/// Times its own lifetime as the given stage.
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(Stage stage)
+        : counters_(local()), stage_(static_cast<std::size_t>(stage)),
+          parent_(counters_.current), start_(ticks()) {
+        counters_.current = stage_;
+    }
+    ~ScopedTimer() {
+        const auto elapsed = ticks() - start_;
+        counters_.ticks[stage_] += elapsed;
+        counters_.calls[stage_]++;
+        if (parent_ != NUM_STAGES) {
+            // unsigned wraparound is fine: the parent adds it back on exit.
+            counters_.ticks[parent_] -= elapsed;
+        }
+        counters_.current = parent_;
+    }
+    ScopedTimer(ScopedTimer const &) = delete;
+    ScopedTimer &operator=(ScopedTimer const &) = delete;
+
+  private:
+    ThreadCounters &counters_;
+    std::size_t stage_;
+    std::size_t parent_;
+    std::uint64_t start_;
+};
+
+inline void count(Counter counter, std::uint64_t n) {
+    local().counts[static_cast<std::size_t>(counter)] += n;
+}
+
+/// Starts the clock for the summary's wall time and rates.
+inline void start() { registry(); }
+
+/// Prints a table of where the time went since start(), with throughput.
+/// Stage times are summed over all threads.
+inline void printSummary(std::ostream &os) {
+    static const char *const STAGE_NAMES[NUM_STAGES] = {
+        "line reading",      "field splitting", "numeric parsing",
+        "tracker advancing", "interpolation",   "output formatting",
+        "output writing"};
+    double seconds = 0;
+    double ticksPerSecond = 1;
+    registry().elapsed(seconds, ticksPerSecond);
+    const auto total = registry().total();
+    auto counted = [&](Counter c) {
+        return total.counts[static_cast<std::size_t>(c)];
+    };
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << "Stage                      calls     seconds   % of wall     "
+          "ns/call\n";
+    for (std::size_t i = 0; i < NUM_STAGES; ++i) {
+        const auto stageSeconds =
+            static_cast<double>(total.ticks[i]) / ticksPerSecond;
+        os << std::left << std::setw(18) << STAGE_NAMES[i] << std::right
+           << std::setw(14) << total.calls[i] << std::setw(12)
+           << stageSeconds << std::setw(12)
+           << (seconds > 0 ? 100. * stageSeconds / seconds : 0.)
+           << std::setw(12)
+           << (total.calls[i] ? stageSeconds * 1e9 / total.calls[i] : 0.)
+           << "\n";
+    }
+    const auto rows = counted(Counter::ReferenceRows);
+    const auto bytes = counted(Counter::InputBytes);
+    const auto queries = counted(Counter::Queries);
+    os << "Wall time: " << seconds << " s\n";
+    os << "Reference rows: " << rows << " ("
+       << (seconds > 0 ? rows / seconds : 0.) << " rows/s)\n";
+    os << "Input: " << bytes << " bytes ("
+       << (seconds > 0 ? bytes / seconds / 1e6 : 0.) << " MB/s)\n";
+    os << "Tracker advances per query: "
+       << (queries ? static_cast<double>(
+                         counted(Counter::TrackerAdvances)) /
+                         queries
+                   : 0.)
+       << std::endl;
+    os.flags(flags);
+    os.precision(precision);
+}
+
+#define MOTIONSYNTH_INSTRUMENT_CONCAT_IMPL(a, b) a##b
+#define MOTIONSYNTH_INSTRUMENT_CONCAT(a, b)                                    \
+    MOTIONSYNTH_INSTRUMENT_CONCAT_IMPL(a, b)
+/// Times the rest of the enclosing scope as the named stage.
+#define MOTIONSYNTH_INSTRUMENT_SCOPE(STAGE)                                    \
+    ::instrument::ScopedTimer MOTIONSYNTH_INSTRUMENT_CONCAT(                   \
+        instrumentTimer, __LINE__)(::instrument::Stage::STAGE)
+/// Adds N to the named counter.
+#define MOTIONSYNTH_INSTRUMENT_COUNT(COUNTER, N)                               \
+    ::instrument::count(::instrument::Counter::COUNTER,                        \
+                        static_cast<std::uint64_t>(N))
+
+#else // MOTION_SYNTHESIZER_INSTRUMENT
+
+inline void start() {}
+inline void printSummary(std::ostream &) {}
+
+#define MOTIONSYNTH_INSTRUMENT_SCOPE(STAGE)                                    \
+    do {                                                                       \
+    } while (0)
+#define MOTIONSYNTH_INSTRUMENT_COUNT(COUNTER, N)                               \
+    do {                                                                       \
+    } while (0)
+
+#endif // MOTION_SYNTHESIZER_INSTRUMENT
+
+} // namespace instrument
+
+#endif // INCLUDED_Instrumentation_h_GUID_B022046E_F55A_43AA_B905_D624F98E27C6
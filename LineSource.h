@@ -0,0 +1,253 @@
+/** @file
+    @brief Header providing sources of CSV lines, handed out as views, from
+   either a stream or a memory-mapped file.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_LineSource_h_GUID_A27C94D1_5E08_4B3F_B6D9_0E81F4C253A7
+#define INCLUDED_LineSource_h_GUID_A27C94D1_5E08_4B3F_B6D9_0E81F4C253A7
+
+// Internal Includes
+#include "CSVTools.h"
+#include "Instrumentation.h"
+#include "MappedFile.h"
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace csvtools {
+
+/// Interface for something handing out successive lines, with line endings
+/// already stripped.
+class LineSource {
+  public:
+    virtual ~LineSource() = default;
+    /// Gets the next line, returning false once out of lines. The view is only
+    /// guaranteed valid until the next call.
+    virtual bool getLine(StringRef &line) = 0;
+    /// Whether the views handed out stay valid after the next call after all.
+    virtual bool linesPersist() const { return false; }
+    /// Whether getLine would return without waiting for more input to come
+    /// in, as only sources of live input ever have to.
+    virtual bool lineReady() { return true; }
+    /// Gets the next line along with the spans of up to numFields of its
+    /// fields, as getFieldSpans would find them. Sources that can split rows
+    /// and fields in a single pass override this.
+    virtual bool getRow(StringRef &line, FieldSpans &spans,
+                        std::size_t numFields) {
+        if (!getLine(line)) {
+            return false;
+        }
+        MOTIONSYNTH_INSTRUMENT_SCOPE(FieldSplitting);
+        getFieldSpans(line, numFields, spans);
+        return true;
+    }
+};
+
+/// Lines read with getCleanLine from a stream, into a reused buffer.
+class StreamLineSource : public LineSource {
+  public:
+    explicit StreamLineSource(std::istream &is) : is_(is) {}
+    bool getLine(StringRef &line) override {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(LineReading);
+        if (!getCleanLine(is_, buf_)) {
+            return false;
+        }
+        MOTIONSYNTH_INSTRUMENT_COUNT(InputBytes, buf_.size() + 1);
+        line = StringRef(buf_);
+        return true;
+    }
+
+  private:
+    std::istream &is_;
+    std::string buf_;
+};
+
+/// Lines found in place in a memory-mapped file: no copies, no read calls.
+/// The views stay valid as long as the mapping does.
+class MappedLineSource : public LineSource {
+  public:
+    explicit MappedLineSource(MappedFile const &file)
+        : data_(file.data()), size_(file.size()) {}
+    /// Lines of just part of a file or other buffer.
+    MappedLineSource(const char *data, std::size_t size)
+        : data_(data), size_(size) {}
+    bool getLine(StringRef &line) override {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(LineReading);
+        if (pos_ >= size_) {
+            return false;
+        }
+        auto begin = data_ + pos_;
+        auto nl = static_cast<const char *>(
+            std::memchr(begin, '\n', size_ - pos_));
+        if (nl) {
+            pos_ = static_cast<std::size_t>(nl - data_) + 1;
+        } else {
+            // last line with no line ending
+            nl = data_ + size_;
+            pos_ = size_;
+        }
+        line = trimLineEnding(
+            StringRef(begin, static_cast<std::size_t>(nl - begin)));
+        MOTIONSYNTH_INSTRUMENT_COUNT(InputBytes, data_ + pos_ - begin);
+        return true;
+    }
+    bool getRow(StringRef &line, FieldSpans &spans,
+                std::size_t numFields) override {
+        /// Finding the line is part of the same pass over it.
+        MOTIONSYNTH_INSTRUMENT_SCOPE(FieldSplitting);
+        if (pos_ >= size_) {
+            return false;
+        }
+        auto begin = data_ + pos_;
+        auto lineLen = scanRow(begin, data_ + size_, numFields, spans);
+        /// Past its newline, if it has one: as getLine leaves it.
+        const auto next = std::min(pos_ + lineLen + 1, size_);
+        MOTIONSYNTH_INSTRUMENT_COUNT(InputBytes, next - pos_);
+        pos_ = next;
+        line = trimLineEnding(StringRef(begin, lineLen));
+        return true;
+    }
+    bool linesPersist() const override { return true; }
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+    /// Offset of the next line to be read.
+    std::size_t position() const { return pos_; }
+    /// Picks up reading at the given offset, which should be the start of a
+    /// line.
+    void seek(std::size_t pos) { pos_ = pos; }
+
+  private:
+    const char *data_;
+    std::size_t size_;
+    std::size_t pos_ = 0;
+};
+
+/// Offset of the first line starting at or after pos in data[0, size): pos
+/// itself if it starts a line, otherwise just past the next newline, or size
+/// if there's none.
+inline std::size_t lineStartAtOrAfter(const char *data, std::size_t size,
+                                      std::size_t pos) {
+    if (pos == 0 || pos >= size || data[pos - 1] == '\n') {
+        return pos < size ? pos : size;
+    }
+    auto nl =
+        static_cast<const char *>(std::memchr(data + pos, '\n', size - pos));
+    return nl ? static_cast<std::size_t>(nl - data) + 1 : size;
+}
+
+/// Chunks per thread when splitting lines up to work on in parallel, so the
+/// load evens out when some chunks take longer than others.
+static const std::size_t CHUNKS_PER_THREAD = 4;
+/// Smallest chunk worth handing to a thread, in bytes.
+static const std::size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+/// How many chunks to split size bytes of lines into for the given number
+/// of threads: at least one.
+inline std::size_t chunkCount(std::size_t size, std::size_t threads) {
+    return std::max<std::size_t>(
+        1, std::min(threads * CHUNKS_PER_THREAD, size / MIN_CHUNK_SIZE));
+}
+
+/// Splits the lines in [begin, end) of data into about equal chunks, at line
+/// boundaries: chunk i is [bounds[i], bounds[i + 1]) of the chunks + 1 bounds
+/// returned. Chunks may be empty if lines are long.
+inline std::vector<std::size_t> splitAtLines(const char *data,
+                                             std::size_t begin,
+                                             std::size_t end,
+                                             std::size_t chunks) {
+    std::vector<std::size_t> bounds(1, begin);
+    for (std::size_t i = 1; i < chunks; ++i) {
+        auto pos = begin + (end - begin) / chunks * i;
+        bounds.push_back(
+            std::max(bounds.back(), lineStartAtOrAfter(data, end, pos)));
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+/// Offset of the start of the line ending just before the line starting at
+/// pos, or begin if pos is begin.
+inline std::size_t previousLineStart(const char *data, std::size_t begin,
+                                     std::size_t pos) {
+    if (pos <= begin) {
+        return begin;
+    }
+    // skip the newline ending the previous line, then look for the one
+    // before it.
+    auto p = pos - 1;
+    while (p > begin && data[p - 1] != '\n') {
+        --p;
+    }
+    return p;
+}
+
+/// Binary search by byte offset over the lines in [begin, end) of data,
+/// which must be in order by their keys: returns the offset of the last line
+/// whose key is not greater than target, or begin if there's none. Only
+/// about log2(end - begin) lines are looked at, each by calling
+/// keyOf(StringRef line, Key &key), which returns false if the line has no
+/// key (those count as greater than any target).
+template <typename Key, typename KeyOf>
+inline std::size_t findLastLineNotAfter(const char *data, std::size_t begin,
+                                        std::size_t end, Key const &target,
+                                        KeyOf keyOf) {
+    /// lo is a line start known to be the answer so far; no line starting
+    /// at or after hi is.
+    auto lo = begin;
+    auto hi = end;
+    Key key;
+    while (true) {
+        auto mid = lo + (hi - lo) / 2;
+        auto probe = lineStartAtOrAfter(data, end, mid > lo ? mid : lo + 1);
+        if (probe >= hi) {
+            if (mid <= lo + 1) {
+                // no line starts strictly between lo and hi.
+                return lo;
+            }
+            hi = mid;
+            continue;
+        }
+        auto nl = static_cast<const char *>(
+            std::memchr(data + probe, '\n', end - probe));
+        auto lineEnd = nl ? static_cast<std::size_t>(nl - data) : end;
+        auto line = trimLineEnding(StringRef(data + probe, lineEnd - probe));
+        if (keyOf(line, key) && !(target < key)) {
+            lo = probe;
+        } else {
+            hi = probe;
+        }
+    }
+}
+
+} // namespace csvtools
+
+#endif // INCLUDED_LineSource_h_GUID_A27C94D1_5E08_4B3F_B6D9_0E81F4C253A7
@@ -0,0 +1,401 @@
+/** @file
+    @brief Header providing non-blocking reading of inputs that are still
+   being written as they're read: standard input, pipes, FIFOs and growing
+   files.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_LiveInput_h_GUID_F02F77C1_F9C0_48B5_8F25_5E7DC34FBE25
+#define INCLUDED_LiveInput_h_GUID_F02F77C1_F9C0_48B5_8F25_5E7DC34FBE25
+
+// Internal Includes
+#include "CSVTools.h"
+#include "Instrumentation.h"
+#include "LineSource.h"
+
+// Library/third-party includes
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Standard includes
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace csvtools {
+
+/// An input that may still be growing while it's read: standard input
+/// ("-"), a pipe or FIFO, or a file another process is appending to. Reads
+/// never block; waiting for more is a separate step, with a time limit.
+/// Non-copyable.
+class LiveInput {
+  public:
+    using clock = std::chrono::steady_clock;
+    /// How often a file with nothing new in it gets looked at again, since
+    /// there's no waiting to be told it grew.
+    enum { POLL_INTERVAL_MS = 1 };
+
+    LiveInput() = default;
+    explicit LiveInput(std::string const &fn) { open(fn); }
+    ~LiveInput() { close(); }
+    LiveInput(LiveInput const &) = delete;
+    LiveInput &operator=(LiveInput const &) = delete;
+
+    /// Opens the named input, or standard input for "-". Opening a FIFO
+    /// doesn't wait for a writer: reading it does, like waiting for data.
+    bool open(std::string const &fn) {
+        close();
+#ifdef _WIN32
+        if (fn == "-") {
+            handle_ = GetStdHandle(STD_INPUT_HANDLE);
+            ownsHandle_ = false;
+        } else {
+            handle_ = CreateFileA(
+                fn.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            ownsHandle_ = true;
+        }
+        if (handle_ == INVALID_HANDLE_VALUE || handle_ == nullptr) {
+            handle_ = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        const auto type = GetFileType(handle_);
+        growing_ = type == FILE_TYPE_DISK;
+        pipe_ = type == FILE_TYPE_PIPE;
+#else
+        if (fn == "-") {
+            fd_ = STDIN_FILENO;
+            ownsFd_ = false;
+        } else {
+            fd_ = ::open(fn.c_str(), O_RDONLY | O_NONBLOCK);
+            ownsFd_ = true;
+        }
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) {
+            close();
+            return false;
+        }
+        growing_ = S_ISREG(st.st_mode);
+        awaitingWriter_ = ownsFd_ && S_ISFIFO(st.st_mode);
+        const int flags = ::fcntl(fd_, F_GETFL);
+        if (flags < 0 || ::fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+            close();
+            return false;
+        }
+        flags_ = flags;
+#endif
+        isOpen_ = true;
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (ownsHandle_ && handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+        }
+        handle_ = INVALID_HANDLE_VALUE;
+#else
+        if (fd_ >= 0) {
+            if (flags_ >= 0) {
+                // standard input is shared: leave it as we found it.
+                ::fcntl(fd_, F_SETFL, flags_);
+            }
+            if (ownsFd_) {
+                ::close(fd_);
+            }
+        }
+        fd_ = -1;
+        flags_ = -1;
+#endif
+        isOpen_ = false;
+        ended_ = false;
+        failed_ = false;
+    }
+
+    explicit operator bool() const { return isOpen_; }
+
+    /// Reads whatever is there, up to len bytes, without waiting. Returns 0
+    /// if there's nothing yet - or, once ended(), nothing ever again.
+    std::size_t read(char *buf, std::size_t len) {
+        if (!isOpen_ || ended_) {
+            return 0;
+        }
+#ifdef _WIN32
+        if (pipe_) {
+            DWORD avail = 0;
+            if (!PeekNamedPipe(handle_, nullptr, 0, nullptr, &avail,
+                               nullptr)) {
+                end(GetLastError() != ERROR_BROKEN_PIPE);
+                return 0;
+            }
+            if (avail == 0) {
+                return 0;
+            }
+            len = std::min<std::size_t>(len, avail);
+        }
+        // Anything else that's neither a file nor a pipe, like a console,
+        // can only be read blocking.
+        DWORD got = 0;
+        if (!ReadFile(handle_, buf,
+                      static_cast<DWORD>(std::min<std::size_t>(len, MAXDWORD)),
+                      &got, nullptr)) {
+            const auto error = GetLastError();
+            end(error != ERROR_BROKEN_PIPE && error != ERROR_HANDLE_EOF);
+            return 0;
+        }
+        if (got == 0 && !growing_) {
+            end(false);
+        }
+        return got;
+#else
+        const auto got = ::read(fd_, buf, len);
+        if (got > 0) {
+            awaitingWriter_ = false;
+            return static_cast<std::size_t>(got);
+        }
+        if (got == 0) {
+            // the end of a pipe, but a file may yet grow, and a FIFO may
+            // not have had a writer yet.
+            if (!growing_ && !awaitingWriter_) {
+                end(false);
+            }
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            end(true);
+        }
+        return 0;
+#endif
+    }
+
+    /// Waits up to maxWait for there to be more to read, returning sooner if
+    /// there may be. Files can only be polled, a little at a time.
+    void wait(clock::duration maxWait) {
+#ifndef _WIN32
+        if (!growing_) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          maxWait)
+                          .count();
+            pollfd pfd = {fd_, POLLIN, 0};
+            const int ready =
+                ::poll(&pfd, 1,
+                       static_cast<int>(std::max<decltype(ms)>(
+                           1, std::min<decltype(ms)>(ms, INT_MAX))));
+            // a FIFO whose writer came and went without writing anything
+            // keeps saying so right away: don't spin on it.
+            if (!(ready > 0 && awaitingWriter_ && (pfd.revents & POLLHUP))) {
+                return;
+            }
+        }
+#endif
+        std::this_thread::sleep_for(std::min<clock::duration>(
+            maxWait, std::chrono::milliseconds(POLL_INTERVAL_MS)));
+    }
+
+    /// Whether there'll never be more to read: the writing end of a pipe
+    /// was closed, or reading failed.
+    bool ended() const { return ended_; }
+    bool failed() const { return failed_; }
+
+  private:
+    void end(bool failed) {
+        ended_ = true;
+        failed_ = failed;
+    }
+    bool isOpen_ = false;
+    /// Whether reading nothing means there's nothing yet, rather than the
+    /// end.
+    bool growing_ = false;
+    bool ended_ = false;
+    bool failed_ = false;
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+    bool ownsHandle_ = false;
+    bool pipe_ = false;
+#else
+    int fd_ = -1;
+    bool ownsFd_ = false;
+    /// Whether this is a FIFO that's given no data yet, so reading nothing
+    /// may just mean nothing's opened it for writing yet.
+    bool awaitingWriter_ = false;
+    /// File status flags to restore on close, once we've changed them.
+    int flags_ = -1;
+#endif
+};
+
+/// Lines of a live input, handed out as soon as each is complete. When the
+/// next one isn't, the before-waiting hook gets called, if set, and then it
+/// waits for more, up to a limit: an input quiet for that long is taken to
+/// have ended.
+class LiveLineSource : public LineSource {
+  public:
+    using clock = LiveInput::clock;
+    static const std::size_t INITIAL_BUFFER_SIZE = 64 * 1024;
+
+    LiveLineSource(LiveInput &input, clock::duration maxWait)
+        : input_(input), maxWait_(maxWait), buf_(INITIAL_BUFFER_SIZE) {}
+
+    bool getLine(StringRef &line) override {
+        bool waiting = false;
+        clock::time_point waitStart;
+        while (true) {
+            auto begin = buf_.data() + pos_;
+            auto nl = static_cast<const char *>(
+                std::memchr(begin, '\n', end_ - pos_));
+            if (nl) {
+                pos_ = static_cast<std::size_t>(nl - buf_.data()) + 1;
+                line = handOut(begin, nl);
+                return true;
+            }
+            if (ended()) {
+                if (pos_ == end_) {
+                    return false;
+                }
+                // last line with no line ending
+                pos_ = end_;
+                line = handOut(begin, buf_.data() + end_);
+                return true;
+            }
+            makeRoom();
+            const auto got =
+                input_.read(buf_.data() + end_, buf_.size() - end_);
+            if (got > 0) {
+                end_ += got;
+                lastRead_ = clock::now();
+                waiting = false;
+                continue;
+            }
+            if (input_.ended()) {
+                continue;
+            }
+            if (!waiting) {
+                if (beforeWaiting_) {
+                    beforeWaiting_();
+                }
+                waiting = true;
+                waitStart = clock::now();
+            }
+            const auto waited = clock::now() - waitStart;
+            if (waited >= maxWait_) {
+                timedOut_ = true;
+                continue;
+            }
+            input_.wait(maxWait_ - waited);
+        }
+    }
+
+    /// Reads what's there, without waiting, to see if a whole line is.
+    bool lineReady() override {
+        if (hasLine() || ended()) {
+            return true;
+        }
+        makeRoom();
+        const auto got = input_.read(buf_.data() + end_, buf_.size() - end_);
+        if (got > 0) {
+            end_ += got;
+            lastRead_ = clock::now();
+        }
+        return hasLine() || input_.ended();
+    }
+
+    /// Called each time a line has to be waited for, e.g. to get out what
+    /// was written so far.
+    void setBeforeWaiting(std::function<void()> fn) {
+        beforeWaiting_ = std::move(fn);
+    }
+
+    /// When the last line handed out came in: the read that completed it.
+    clock::time_point lineArrival() const { return lineArrival_; }
+
+    /// Whether the lines ended for want of any more within the wait limit.
+    bool timedOut() const { return timedOut_; }
+    bool failed() const { return input_.failed(); }
+
+  private:
+    bool ended() const { return timedOut_ || input_.ended(); }
+    bool hasLine() const {
+        return std::memchr(buf_.data() + pos_, '\n', end_ - pos_) != nullptr;
+    }
+
+    StringRef handOut(const char *begin, const char *end) {
+        // Only reads with no whole line left over happen, so that was the
+        // last one.
+        lineArrival_ = lastRead_;
+        MOTIONSYNTH_INSTRUMENT_COUNT(InputBytes, buf_.data() + pos_ - begin);
+        return trimLineEnding(
+            StringRef(begin, static_cast<std::size_t>(end - begin)));
+    }
+
+    /// Makes sure there's room at the end of the buffer to read into, moving
+    /// the partial line to the front, or growing to fit a long one.
+    void makeRoom() {
+        if (pos_ == end_) {
+            pos_ = end_ = 0;
+        }
+        if (end_ < buf_.size()) {
+            return;
+        }
+        if (pos_ > 0) {
+            std::memmove(buf_.data(), buf_.data() + pos_, end_ - pos_);
+            end_ -= pos_;
+            pos_ = 0;
+        } else {
+            buf_.resize(buf_.size() * 2);
+        }
+    }
+
+    LiveInput &input_;
+    clock::duration maxWait_;
+    std::function<void()> beforeWaiting_;
+    std::vector<char> buf_;
+    /// Start of what's not been handed out yet, and end of what's been read.
+    std::size_t pos_ = 0;
+    std::size_t end_ = 0;
+    clock::time_point lastRead_;
+    clock::time_point lineArrival_;
+    bool timedOut_ = false;
+};
+
+} // namespace csvtools
+
+#endif // INCLUDED_LiveInput_h_GUID_F02F77C1_F9C0_48B5_8F25_5E7DC34FBE25
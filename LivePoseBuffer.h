@@ -0,0 +1,336 @@
+/** @file
+    @brief Header providing a lock-free buffer of the latest tracker samples,
+   filled by one thread as they arrive and interpolated from by any number of
+   others at once, for embedding the interpolator in a real-time runtime.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_LivePoseBuffer_h_GUID_034C0FD7_7319_4CA4_A457_F7326759A193
+#define INCLUDED_LivePoseBuffer_h_GUID_034C0FD7_7319_4CA4_A457_F7326759A193
+
+// Internal Includes
+#include "Instrumentation.h"
+#include "MotionSynthesizer.h"
+#include "SPSCQueue.h"
+#include "Slerp.h"
+#include "Timestamp.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace motionsynth {
+
+/// Ring of the most recent tracker samples, pushed by exactly one thread -
+/// say, a tracker callback - and queried for the pose at any time they span
+/// by any number of others, such as a compositor wanting the pose at display
+/// time. Neither side takes a lock or allocates: each slot is guarded by a
+/// sequence count (a seqlock), so a reader copies a sample out and then
+/// checks that it wasn't overwritten while it did. A reader never holds up
+/// the writer; a reader overtaken by it just looks again.
+///
+/// Queries take the same statuses as the file engines: before the oldest
+/// sample still held, after the newest (or Extrapolated, within the
+/// horizon, if extrapolation is on), or OutOfData until there are two
+/// samples to go on.
+class LivePoseBuffer {
+  public:
+    /// The capacity is rounded up to a power of two, of at least two.
+    explicit LivePoseBuffer(
+        std::size_t capacity,
+        RotationPolicy const &rotation = RotationPolicy(),
+        ExtrapolationPolicy const &extrapolation = ExtrapolationPolicy())
+        : nlerpMinDot_(slerp::nlerpMinDot(rotation.maxNlerpError)),
+          extrapolation_(extrapolation) {
+        std::size_t n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+        slots_.reset(new Slot[n]);
+        mask_ = n - 1;
+        extrapolation_.window = std::max<std::size_t>(extrapolation.window, 1);
+    }
+    LivePoseBuffer(LivePoseBuffer const &) = delete;
+    LivePoseBuffer &operator=(LivePoseBuffer const &) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    /// Producer only: adds the next sample, overwriting the oldest once
+    /// full. False, and dropped, if it isn't later than the last one, so the
+    /// ring stays in time order.
+    bool push(Nanoseconds t, Eigen::Vector3d const &xlate,
+              Eigen::Quaterniond const &rot) {
+        if (pushed_ > 0 && t <= lastTime_) {
+            return false;
+        }
+        const auto k = pushed_;
+        auto &slot = slots_[k & mask_];
+        slot.sequence.store(2 * k + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time.store(t, std::memory_order_relaxed);
+        const double pose[POSE_VALUES] = {xlate.x(), xlate.y(), xlate.z(),
+                                          rot.w(),   rot.x(),   rot.y(),
+                                          rot.z()};
+        for (std::size_t i = 0; i < POSE_VALUES; ++i) {
+            slot.pose[i].store(pose[i], std::memory_order_relaxed);
+        }
+        slot.sequence.store(2 * k + 2, std::memory_order_release);
+        pushed_ = k + 1;
+        lastTime_ = t;
+        count_.store(pushed_, std::memory_order_release);
+        return true;
+    }
+
+    /// Number of samples pushed so far, including those since overwritten.
+    std::uint64_t size() const {
+        return count_.load(std::memory_order_acquire);
+    }
+
+    /// Any thread: the newest sample. False if there's none yet.
+    bool latest(Nanoseconds &t, Eigen::Vector3d &xlate,
+                Eigen::Quaterniond &rot) const {
+        for (unsigned attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            const auto count = count_.load(std::memory_order_acquire);
+            if (count == 0) {
+                return false;
+            }
+            Sample sample;
+            if (readSample(count - 1, sample)) {
+                t = sample.time;
+                xlate = sample.xlate;
+                rot = sample.rot;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Any thread: the pose at tv, interpolated between the two samples
+    /// around it, in any order.
+    Status operator()(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                      Eigen::Quaterniond &outRot) const {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(Interpolation);
+        MOTIONSYNTH_INSTRUMENT_COUNT(Queries, 1);
+        Status status = Status::OtherUnexpectedFailure;
+        for (unsigned attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+            if (tryQuery(tv, outXlate, outRot, status)) {
+                return status;
+            }
+        }
+        /// The samples it needed kept getting overwritten: it's that close
+        /// to falling off the end of the ring.
+        return Status::BeforeRecordedTrackerData;
+    }
+
+  private:
+    /// Translation, then rotation as w, x, y, z.
+    static const std::size_t POSE_VALUES = 7;
+    /// Times a reader starts over after being overtaken by the writer.
+    static const unsigned MAX_ATTEMPTS = 4;
+
+    struct Slot {
+        /// 2k + 1 while sample k is being written into it, 2k + 2 once it's
+        /// done, so a reader can tell both a write in progress and a slot
+        /// that's moved on to a later sample.
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<Nanoseconds> time{0};
+        std::atomic<double> pose[POSE_VALUES];
+    };
+
+    /// A reader's own copy of a sample.
+    struct Sample {
+        Nanoseconds time;
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+    };
+
+    /// Sample k's time, if it's still there.
+    bool readTime(std::uint64_t k, Nanoseconds &t) const {
+        auto const &slot = slots_[k & mask_];
+        const auto done = 2 * k + 2;
+        if (slot.sequence.load(std::memory_order_acquire) != done) {
+            return false;
+        }
+        t = slot.time.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == done;
+    }
+
+    /// Sample k, if it's still there.
+    bool readSample(std::uint64_t k, Sample &sample) const {
+        auto const &slot = slots_[k & mask_];
+        const auto done = 2 * k + 2;
+        if (slot.sequence.load(std::memory_order_acquire) != done) {
+            return false;
+        }
+        sample.time = slot.time.load(std::memory_order_relaxed);
+        double pose[POSE_VALUES];
+        for (std::size_t i = 0; i < POSE_VALUES; ++i) {
+            pose[i] = slot.pose[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != done) {
+            return false;
+        }
+        sample.xlate = Eigen::Vector3d(pose[0], pose[1], pose[2]);
+        sample.rot = Eigen::Quaterniond(pose[3], pose[4], pose[5], pose[6]);
+        return true;
+    }
+
+    /// One go at a query: false if overtaken by the writer, to start over.
+    bool tryQuery(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                  Eigen::Quaterniond &outRot, Status &status) const {
+        const auto count = count_.load(std::memory_order_acquire);
+        if (count < 2) {
+            status = Status::OutOfData;
+            return true;
+        }
+        const auto last = count - 1;
+        const std::uint64_t oldest =
+            count > capacity() ? count - capacity() : 0;
+        Sample end;
+        if (!readSample(last, end)) {
+            return false;
+        }
+        if (tv >= end.time) {
+            if (tv == end.time) {
+                /// right on the newest.
+                outXlate = end.xlate;
+                outRot = end.rot;
+                status = Status::Successful;
+                return true;
+            }
+            if (tv - end.time > extrapolation_.maxHorizon) {
+                status = Status::AfterRecordedTrackerData;
+                return true;
+            }
+            return extrapolate(tv, last, oldest, end, outXlate, outRot,
+                               status);
+        }
+
+        /// Last sample at or before tv: gallop back from the newest, where
+        /// display-time queries land, then bisect. t[lo] <= tv < t[hi].
+        std::uint64_t lo = 0;
+        std::uint64_t hi = last;
+        Nanoseconds t = 0;
+        for (std::uint64_t step = 1;; step *= 2) {
+            const auto probe = hi - oldest > step ? hi - step : oldest;
+            if (!readTime(probe, t)) {
+                return false;
+            }
+            if (t <= tv) {
+                lo = probe;
+                break;
+            }
+            if (probe == oldest) {
+                status = Status::BeforeRecordedTrackerData;
+                return true;
+            }
+            hi = probe;
+        }
+        while (hi - lo > 1) {
+            const auto mid = lo + (hi - lo) / 2;
+            if (!readTime(mid, t)) {
+                return false;
+            }
+            if (t <= tv) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        Sample start;
+        if (!readSample(lo, start) || !readSample(hi, end)) {
+            return false;
+        }
+        if (tv == start.time) {
+            /// right on the start.
+            outXlate = start.xlate;
+            outRot = start.rot;
+        } else {
+            const auto frac = static_cast<double>(tv - start.time) *
+                              perNanosecond(end.time - start.time);
+            interpolatePose(frac, start.xlate, end.xlate - start.xlate,
+                            slerp::constants(start.rot, end.rot, nlerpMinDot_),
+                            outXlate, outRot);
+        }
+        status = Status::Successful;
+        return true;
+    }
+
+    /// Pose at tv, past the newest sample (last) but within the horizon,
+    /// carrying on at the velocity over the window's worth of intervals
+    /// before it - or as many as are held.
+    bool extrapolate(Nanoseconds tv, std::uint64_t last, std::uint64_t oldest,
+                     Sample const &end, Eigen::Vector3d &outXlate,
+                     Eigen::Quaterniond &outRot, Status &status) const {
+        const auto intervals =
+            std::min<std::uint64_t>(extrapolation_.window, last - oldest);
+        Nanoseconds duration = 0;
+        Eigen::Vector3d xlate = Eigen::Vector3d::Zero();
+        Eigen::Vector3d rot = Eigen::Vector3d::Zero();
+        Sample later = end;
+        Sample earlier;
+        for (std::uint64_t i = 1; i <= intervals; ++i) {
+            if (!readSample(last - i, earlier)) {
+                return false;
+            }
+            duration += later.time - earlier.time;
+            xlate += later.xlate - earlier.xlate;
+            rot += rotationVector(earlier.rot, later.rot);
+            later = earlier;
+        }
+        extrapolatePose(tv - end.time, duration, xlate, rot, end.xlate,
+                        end.rot, outXlate, outRot);
+        status = Status::Extrapolated;
+        return true;
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+    /// From the rotation policy: intervals with |start . end| at least this
+    /// use nlerp.
+    double nlerpMinDot_;
+    ExtrapolationPolicy extrapolation_;
+
+    /// Samples published so far: all of the first count_ are written,
+    /// though the oldest may since have been overwritten.
+    alignas(pipeline::CACHE_LINE_SIZE) std::atomic<std::uint64_t> count_{0};
+
+    /// @name Producer side
+    /// @{
+    alignas(pipeline::CACHE_LINE_SIZE) std::uint64_t pushed_ = 0;
+    Nanoseconds lastTime_ = 0;
+    /// @}
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_LivePoseBuffer_h_GUID_034C0FD7_7319_4CA4_A457_F7326759A193
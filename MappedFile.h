@@ -0,0 +1,210 @@
+/** @file
+    @brief Header providing a read-only memory mapping of a whole file.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_MappedFile_h_GUID_6F0D2A4E_93B1_4C57_8E2A_D15C7B36A0F9
+#define INCLUDED_MappedFile_h_GUID_6F0D2A4E_93B1_4C57_8E2A_D15C7B36A0F9
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Standard includes
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace csvtools {
+
+/// Hints passed along to the OS when mapping a file.
+struct MapHints {
+    /// We'll read front to back: ask for aggressive readahead and early
+    /// reclaim of pages behind us.
+    bool sequential = true;
+    /// Ask for transparent huge pages backing the mapping, where the kernel
+    /// and filesystem support it. Purely advisory.
+    bool hugePages = false;
+};
+
+/// Read-only mapping of an entire file, usable like an ifstream in a boolean
+/// context to see if opening succeeded. Non-copyable, movable.
+class MappedFile {
+  public:
+    MappedFile() = default;
+    explicit MappedFile(std::string const &fn, MapHints hints = MapHints()) {
+        open(fn, hints);
+    }
+    ~MappedFile() { close(); }
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) { swap(other); }
+    MappedFile &operator=(MappedFile &&other) {
+        if (this != &other) {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+
+    /// Maps the named file, replacing any previous mapping.
+    bool open(std::string const &fn, MapHints hints = MapHints()) {
+        close();
+#ifdef _WIN32
+        (void)hints;
+        file_ = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            close();
+            return false;
+        }
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        isOpen_ = true;
+        if (0 == size_) {
+            // can't map an empty file, but it's a perfectly fine empty range
+            return true;
+        }
+        mapping_ =
+            CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char *>(
+            MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_) {
+            close();
+            return false;
+        }
+#else
+        fd_ = ::open(fn.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close();
+            return false;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        isOpen_ = true;
+        if (0 == size_) {
+            // can't map an empty file, but it's a perfectly fine empty range
+            return true;
+        }
+        void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (addr == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char *>(addr);
+        if (hints.sequential) {
+            ::madvise(addr, size_, MADV_SEQUENTIAL);
+        }
+#ifdef MADV_HUGEPAGE
+        if (hints.hugePages) {
+            ::madvise(addr, size_, MADV_HUGEPAGE);
+        }
+#endif
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        isOpen_ = false;
+    }
+
+    bool is_open() const { return isOpen_; }
+    explicit operator bool() const { return isOpen_; }
+
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    void swap(MappedFile &other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(isOpen_, other.isOpen_);
+#ifdef _WIN32
+        std::swap(file_, other.file_);
+        std::swap(mapping_, other.mapping_);
+#else
+        std::swap(fd_, other.fd_);
+#endif
+    }
+
+  private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+    bool isOpen_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace csvtools
+
+#endif // INCLUDED_MappedFile_h_GUID_6F0D2A4E_93B1_4C57_8E2A_D15C7B36A0F9
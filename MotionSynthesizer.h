@@ -0,0 +1,553 @@
+/** @file
+    @brief Header providing the streaming interpolator, which walks through
+   tracker data in step with sequential reference timestamps.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_MotionSynthesizer_h_GUID_93A6F0C8_2B1E_4D7A_8F54_E0C2B7913D6A
+#define INCLUDED_MotionSynthesizer_h_GUID_93A6F0C8_2B1E_4D7A_8F54_E0C2B7913D6A
+
+// Internal Includes
+#include "Instrumentation.h"
+#include "Slerp.h"
+#include "TrackerSource.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+#include <stdexcept>
+#include <vector>
+
+namespace motionsynth {
+
+enum class Status {
+    BeforeRecordedTrackerData,
+    Successful,
+    OutOfData,
+    /// Only from engines that can answer queries in any order: this one's
+    /// past the end, but a later query might not be.
+    AfterRecordedTrackerData,
+    /// Only with extrapolation on: past the tracker data read so far, but
+    /// within the horizon, so the pose was predicted rather than
+    /// interpolated.
+    Extrapolated,
+    OtherUnexpectedFailure
+};
+
+/// 1 / an interval's length, or 0 for an empty one. Fractions of the way
+/// through are always taken by multiplying by this rather than dividing, so
+/// engines that keep it per interval and those that work it out per query
+/// agree to the bit.
+inline double perNanosecond(Nanoseconds duration) {
+    return duration > 0 ? 1. / static_cast<double>(duration) : 0.;
+}
+
+/// Pose a fraction t of the way through an interval: lerp the translation
+/// (given its start and total change), slerp the rotation (given the
+/// interval's slerp constants).
+inline void interpolatePose(double t, Eigen::Vector3d const &startXlate,
+                            Eigen::Vector3d const &incXlate,
+                            slerp::Constants const &rotConstants,
+                            Eigen::Vector3d &outXlate,
+                            Eigen::Quaterniond &outRot) {
+    /// Slerp the rotation
+    outRot = slerp::interpolate(rotConstants, t);
+
+    /// Lerp the translation
+    outXlate = startXlate + t * incXlate;
+}
+
+inline void interpolatePose(double t, Eigen::Vector3d const &startXlate,
+                            Eigen::Vector3d const &incXlate,
+                            Eigen::Quaterniond const &startRot,
+                            Eigen::Quaterniond const &endRot,
+                            Eigen::Vector3d &outXlate,
+                            Eigen::Quaterniond &outRot) {
+    interpolatePose(t, startXlate, incXlate,
+                    slerp::constants(startRot, endRot), outXlate, outRot);
+}
+
+/// Structure-of-arrays destination for batch interpolation: each pointer must
+/// have room for one element per query in the batch.
+struct PoseArrays {
+    double *x;
+    double *y;
+    double *z;
+    double *qw;
+    double *qx;
+    double *qy;
+    double *qz;
+    /// For queries outside the tracker data instead: the range of it the
+    /// engine had right then, for messages.
+    Nanoseconds *rangeStart;
+    Nanoseconds *rangeEnd;
+
+    void store(std::size_t i, Eigen::Vector3d const &xlate,
+               Eigen::Quaterniond const &rot) const {
+        x[i] = xlate.x();
+        y[i] = xlate.y();
+        z[i] = xlate.z();
+        qw[i] = rot.w();
+        qx[i] = rot.x();
+        qy[i] = rot.y();
+        qz[i] = rot.z();
+    }
+
+    void storeRange(std::size_t i, Nanoseconds start, Nanoseconds end) const {
+        rangeStart[i] = start;
+        rangeEnd[i] = end;
+    }
+};
+
+/// How rotations are interpolated within a tracker interval.
+struct RotationPolicy {
+    /// Largest rotation error, in radians, to accept from normalized lerp in
+    /// place of slerp. Intervals turning little enough for nlerp to stay
+    /// within it skip the trig entirely; 0 means always slerp.
+    double maxNlerpError = 0;
+};
+
+/// Whether and how far to predict poses past the tracker data read so far,
+/// by carrying on at the velocity it was last moving at.
+struct ExtrapolationPolicy {
+    /// Furthest past the last tracker sample to predict, or 0 for never.
+    Nanoseconds maxHorizon = 0;
+    /// Number of most recent tracker intervals to average the velocity
+    /// over: more smooths out jitter, but lags behind changes.
+    std::size_t window = 1;
+};
+
+/// Rotation taking from to to, as a rotation vector (axis times angle), the
+/// short way around.
+inline Eigen::Vector3d rotationVector(Eigen::Quaterniond const &from,
+                                      Eigen::Quaterniond const &to) {
+    Eigen::Quaterniond delta = (to * from.conjugate()).normalized();
+    if (delta.w() < 0) {
+        delta.coeffs() = -delta.coeffs();
+    }
+    const Eigen::AngleAxisd turn(delta);
+    return turn.angle() * turn.axis();
+}
+
+/// Pose ahead past a sample at endXlate and endRot, carrying on at the
+/// velocity of having moved xlate and turned rot (a rotation vector) over
+/// duration - or staying put, if there's no duration to go on.
+inline void extrapolatePose(Nanoseconds ahead, Nanoseconds duration,
+                            Eigen::Vector3d const &xlate,
+                            Eigen::Vector3d const &rot,
+                            Eigen::Vector3d const &endXlate,
+                            Eigen::Quaterniond const &endRot,
+                            Eigen::Vector3d &outXlate,
+                            Eigen::Quaterniond &outRot) {
+    outXlate = endXlate;
+    outRot = endRot;
+    if (duration <= 0) {
+        return;
+    }
+    const auto scale =
+        static_cast<double>(ahead) / static_cast<double>(duration);
+    outXlate += scale * xlate;
+    const Eigen::Vector3d turn = scale * rot;
+    const auto angle = turn.norm();
+    if (angle > 0) {
+        outRot = Eigen::AngleAxisd(angle, turn / angle) * endRot;
+    }
+}
+
+class MotionSynthesizer {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    MotionSynthesizer(TrackerSource &trackerData,
+                      RotationPolicy const &policy = RotationPolicy())
+        : trackerData_(trackerData),
+          nlerpMinDot_(slerp::nlerpMinDot(policy.maxNlerpError)) {
+        if (!readTrackerPose(start_, startXlate_, startRot_)) {
+            throw std::runtime_error("Could not read the initial data row "
+                                     "from the tracker data!");
+        }
+        if (!readTrackerPose(end_, endXlate_, endRot_)) {
+            throw std::runtime_error("Could not read the second data row "
+                                     "from the tracker data!");
+        }
+        updateCachedIntervalData();
+    }
+    /// Starts from the tracker interval containing startAt instead of the
+    /// first one, so the first query can be anywhere in the data. The source
+    /// must be able to seek.
+    MotionSynthesizer(TrackerSource &trackerData, Nanoseconds startAt,
+                      RotationPolicy const &policy = RotationPolicy())
+        : MotionSynthesizer(seekTo(trackerData, startAt), policy) {}
+
+    bool outOfData() const { return done_; }
+
+    /// Turns extrapolation past the tracker data on or off. With it on, a
+    /// query past the data read so far that's within the horizon gets a
+    /// predicted pose - right away, if more tracker data would have to be
+    /// waited for - and a query past that waits or runs out as usual.
+    void setExtrapolation(ExtrapolationPolicy const &policy) {
+        extrapolation_ = policy;
+        extrapolation_.window = std::max<std::size_t>(policy.window, 1);
+        recentMotion_.clear();
+        if (extrapolating()) {
+            noteMotion();
+        }
+    }
+
+    /// Feed me with SEQUENTIAL timestamps and I'll give you interpolated
+    /// data for them, modulo some caveats.
+    Status operator()(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                      Eigen::Quaterniond &outRot) {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(Interpolation);
+        MOTIONSYNTH_INSTRUMENT_COUNT(Queries, 1);
+        if (isBeforeTrackerData(tv)) {
+            return Status::BeforeRecordedTrackerData;
+        }
+        switch (moveTo(tv)) {
+        case Reach::Extrapolate:
+            extrapolate(tv, outXlate, outRot);
+            return Status::Extrapolated;
+        case Reach::OutOfData:
+            return Status::OutOfData;
+        default:
+            break;
+        }
+        auto result = getInterpolation(tv, outXlate, outRot);
+        if (!result) {
+            return Status::OtherUnexpectedFailure;
+        }
+        return Status::Successful;
+    }
+
+    /// Batch form of operator(): the n timestamps must be sequential, and
+    /// status[i] says whether the pose for tvs[i] was stored at index i of
+    /// out. Once out of tracker data, the rest of the batch is OutOfData -
+    /// but for any extrapolated first.
+    ///
+    /// The interval is only looked up when a query leaves the current one, and
+    /// its data is held in locals across the run of queries that share it.
+    void interpolate(Nanoseconds const *tvs, std::size_t n,
+                     PoseArrays const &out, Status *status) {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(Interpolation);
+        MOTIONSYNTH_INSTRUMENT_COUNT(Queries, n);
+        std::size_t i = 0;
+        while (i < n) {
+            const auto tv = tvs[i];
+            if (isBeforeTrackerData(tv)) {
+                out.storeRange(i, start_, end_);
+                status[i++] = Status::BeforeRecordedTrackerData;
+                continue;
+            }
+            switch (moveTo(tv)) {
+            case Reach::Extrapolate: {
+                Eigen::Vector3d xlate;
+                Eigen::Quaterniond rot;
+                extrapolate(tv, xlate, rot);
+                out.store(i, xlate, rot);
+                status[i++] = Status::Extrapolated;
+                continue;
+            }
+            case Reach::OutOfData:
+                for (; i < n; ++i) {
+                    status[i] = Status::OutOfData;
+                }
+                return;
+            default:
+                break;
+            }
+            const Nanoseconds start = start_;
+            const Nanoseconds end = end_;
+            const Eigen::Vector3d startXlate = startXlate_;
+            const Eigen::Vector3d incXlate = incXlate_;
+            const double inverseDuration = perNanosecond_;
+            if (fractions_.size() < n) {
+                fractions_.resize(n);
+            }
+            /// Everything up to the end of this interval, starting with tv:
+            /// translations now, rotations all at once after.
+            const std::size_t runBegin = i;
+            for (; i < n && start <= tvs[i] && tvs[i] <= end; ++i) {
+                double t = 0;
+                if (tvs[i] == start) {
+                    t = 0;
+                } else if (tvs[i] == end) {
+                    t = 1;
+                } else {
+                    t = static_cast<double>(tvs[i] - start) * inverseDuration;
+                }
+                fractions_[i] = t;
+                out.x[i] = startXlate.x() + t * incXlate.x();
+                out.y[i] = startXlate.y() + t * incXlate.y();
+                out.z[i] = startXlate.z() + t * incXlate.z();
+                status[i] = Status::Successful;
+            }
+            slerp::QuatArrays rots = {out.qw + runBegin, out.qx + runBegin,
+                                      out.qy + runBegin, out.qz + runBegin};
+            slerp::interpolate(rotConstants_, fractions_.data() + runBegin,
+                               i - runBegin, rots);
+            /// Samples hit exactly are copied as-is.
+            for (auto j = runBegin; j < i; ++j) {
+                if (tvs[j] == start) {
+                    out.store(j, startXlate_, startRot_);
+                } else if (tvs[j] == end) {
+                    out.store(j, endXlate_, endRot_);
+                }
+            }
+        }
+    }
+
+    /// @name Rotation interpolation statistics
+    /// @{
+    /// Number of tracker intervals set up for slerp and for nlerp so far.
+    std::uint64_t slerpIntervals() const { return slerpIntervals_; }
+    std::uint64_t nlerpIntervals() const { return nlerpIntervals_; }
+    /// @}
+
+    Nanoseconds getStartTime() const { return start_; };
+    Nanoseconds getEndTime() const { return end_; };
+
+  private:
+    static TrackerSource &seekTo(TrackerSource &trackerData, Nanoseconds t) {
+        if (!trackerData.seek(t)) {
+            throw std::runtime_error("This tracker data can't be read "
+                                     "starting from the middle!");
+        }
+        return trackerData;
+    }
+    bool isBeforeTrackerData(Nanoseconds tv) const { return tv < start_; }
+    bool trackerDataNeedsAdvancing(Nanoseconds tv) const { return end_ < tv; }
+    bool extrapolating() const { return extrapolation_.maxHorizon > 0; }
+    bool withinHorizon(Nanoseconds tv) const {
+        return tv - end_ <= extrapolation_.maxHorizon;
+    }
+
+    /// Where a query at or after the start of the data stands, once the
+    /// tracker data's been moved along as far as it needs to be.
+    enum class Reach { Interpolate, Extrapolate, OutOfData };
+    Reach moveTo(Nanoseconds tv) {
+        if (trackerDataNeedsAdvancing(tv) && !done_) {
+            if (extrapolating()) {
+                /// What's in already, then only wait for more if tv is too
+                /// far ahead to predict.
+                advanceTrackerData(tv, false);
+                if (trackerDataNeedsAdvancing(tv) && !done_ &&
+                    !withinHorizon(tv)) {
+                    advanceTrackerData(tv, true);
+                }
+            } else {
+                advanceTrackerData(tv, true);
+            }
+        }
+        if (!trackerDataNeedsAdvancing(tv)) {
+            return done_ ? Reach::OutOfData : Reach::Interpolate;
+        }
+        return extrapolating() && withinHorizon(tv) ? Reach::Extrapolate
+                                                    : Reach::OutOfData;
+    }
+
+    /// Pose at tv, past the end of the interval, carrying on from the end at
+    /// the average velocity over the recent intervals.
+    void extrapolate(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                     Eigen::Quaterniond &outRot) const {
+        Nanoseconds duration = 0;
+        Eigen::Vector3d xlate = Eigen::Vector3d::Zero();
+        Eigen::Vector3d rot = Eigen::Vector3d::Zero();
+        for (auto const &motion : recentMotion_) {
+            duration += motion.duration;
+            xlate += motion.xlate;
+            rot += motion.rot;
+        }
+        extrapolatePose(tv - end_, duration, xlate, rot, endXlate_, endRot_,
+                        outXlate, outRot);
+    }
+
+    /// Adds the interval's motion to the recent ones, for extrapolating.
+    void noteMotion() {
+        if (recentMotion_.size() == extrapolation_.window) {
+            recentMotion_.erase(recentMotion_.begin());
+        }
+        recentMotion_.push_back(
+            {end_ - start_, incXlate_, rotationVector(startRot_, endRot_)});
+    }
+
+    void updateCachedIntervalData() {
+        perNanosecond_ = perNanosecond(end_ - start_);
+        incXlate_ = endXlate_ - startXlate_;
+        rotConstants_ = slerp::constants(startRot_, endRot_, nlerpMinDot_);
+        if (rotConstants_.normalize) {
+            nlerpIntervals_++;
+        } else {
+            slerpIntervals_++;
+        }
+        if (extrapolating()) {
+            noteMotion();
+        }
+    }
+    bool getInterpolation(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                          Eigen::Quaterniond &outRot) const {
+        if (tv == start_) {
+            /// right on the start.
+            outXlate = startXlate_;
+            outRot = startRot_;
+            return true;
+        }
+        if (tv == end_) {
+            /// right on the end.
+            outXlate = endXlate_;
+            outRot = endRot_;
+            return true;
+        }
+        if (isBeforeTrackerData(tv) || trackerDataNeedsAdvancing(tv)) {
+            /// can't interpolate here.
+            return false;
+        }
+        auto t = static_cast<double>(tv - start_) * perNanosecond_;
+        interpolatePose(t, startXlate_, incXlate_, rotConstants_, outXlate,
+                        outRot);
+        return true;
+    }
+    /// Moves us along to the interval containing tv, which is past the end
+    /// of this one - false if out of data first. Only the timestamps of the
+    /// rows passed over get parsed: poses just for the two that end up
+    /// bracketing tv. Unless told to wait, it stops short at the last
+    /// interval that's in already instead of waiting for more.
+    bool advanceTrackerData(Nanoseconds tv, bool wait) {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(TrackerAdvancing);
+        std::size_t rows = 0;
+        const auto lastDecoded = end_;
+        Nanoseconds next = 0;
+        do {
+            if (!wait && !trackerData_.sampleReady()) {
+                break;
+            }
+            MOTIONSYNTH_INSTRUMENT_COUNT(TrackerAdvances, 1);
+            if (!trackerData_.readTimestamp(next)) {
+                // couldn't read another line - out of data
+                done_ = true;
+                if (extrapolating()) {
+                    keepFinalSample(rows, lastDecoded);
+                } else {
+                    start_ = end_;
+                }
+                return false;
+            }
+            start_ = end_;
+            end_ = next;
+            ++rows;
+        } while (trackerDataNeedsAdvancing(tv));
+        if (rows == 0) {
+            return true;
+        }
+        if (rows == 1) {
+            startXlate_ = endXlate_;
+            startRot_ = endRot_;
+        } else if (!trackerData_.decodePose(TrackerSource::Recent::BeforeLast,
+                                            startXlate_, startRot_)) {
+            done_ = true;
+            return false;
+        }
+        if (!trackerData_.decodePose(TrackerSource::Recent::Last, endXlate_,
+                                     endRot_)) {
+            done_ = true;
+            return false;
+        }
+        updateCachedIntervalData();
+        return true;
+    }
+    /// Out of data while extrapolating, after passing over rows more: ends
+    /// the data at the very last sample, with the interval reaching back to
+    /// the last one decoded, so extrapolating carries on from there.
+    void keepFinalSample(std::size_t rows, Nanoseconds lastDecoded) {
+        if (rows == 0) {
+            return;
+        }
+        const auto last = end_;
+        start_ = end_ = lastDecoded;
+        startXlate_ = endXlate_;
+        startRot_ = endRot_;
+        if (!trackerData_.decodePose(TrackerSource::Recent::Last, endXlate_,
+                                     endRot_)) {
+            return;
+        }
+        end_ = last;
+        updateCachedIntervalData();
+    }
+
+    /// utility
+    bool readTrackerPose(Nanoseconds &t, Eigen::Vector3d &xlate,
+                         Eigen::Quaterniond &rot) {
+        return trackerData_.readPose(t, xlate, rot);
+    }
+
+    TrackerSource &trackerData_;
+
+    Nanoseconds start_ = 0;
+    Eigen::Vector3d startXlate_;
+    Eigen::Quaterniond startRot_;
+
+    Nanoseconds end_ = 0;
+    Eigen::Vector3d endXlate_;
+    Eigen::Quaterniond endRot_;
+
+    bool done_ = false;
+
+    /// @name Cached interval data
+    /// @{
+    /// 1 / the interval's length, so a query's fraction of the way through is
+    /// a subtraction and a multiply.
+    double perNanosecond_ = 0;
+    Eigen::Vector3d incXlate_;
+    /// Angle, 1 / sin of it and hemisphere sign, so each query in the
+    /// interval is just two sin evaluations and a multiply-add.
+    slerp::Constants rotConstants_;
+    /// @}
+
+    /// From the rotation policy: intervals with |start . end| at least this
+    /// use nlerp.
+    double nlerpMinDot_;
+    std::uint64_t slerpIntervals_ = 0;
+    std::uint64_t nlerpIntervals_ = 0;
+
+    ExtrapolationPolicy extrapolation_;
+    /// What happened over an interval: how long it was, and how far it
+    /// moved and turned.
+    struct Motion {
+        Nanoseconds duration;
+        Eigen::Vector3d xlate;
+        Eigen::Vector3d rot;
+    };
+    /// The most recent intervals' motion, oldest first, up to the window,
+    /// when extrapolating.
+    std::vector<Motion> recentMotion_;
+
+    /// Scratch space for batch interpolation.
+    std::vector<double> fractions_;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_MotionSynthesizer_h_GUID_93A6F0C8_2B1E_4D7A_8F54_E0C2B7913D6A
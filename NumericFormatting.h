@@ -0,0 +1,492 @@
+/** @file
+    @brief Header providing fast double-to-text conversion, in shortest
+   round-trip or fixed-decimals form, writing straight into a caller's buffer.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_NumericFormatting_h_GUID_58D1A6C3_4E7F_4B92_A0C8_E36F15B927D4
+#define INCLUDED_NumericFormatting_h_GUID_58D1A6C3_4E7F_4B92_A0C8_E36F15B927D4
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace numformat {
+
+/// Enough room for any number written by the functions below.
+static const std::size_t MAX_FORMATTED_LENGTH = 32;
+
+/// Most decimals supported by formatFixed.
+static const int MAX_FIXED_DECIMALS = 15;
+
+namespace detail {
+    /// Writes non-finite values the way printf's %g does.
+    inline char *formatNonFinite(char *out, double val) {
+        if (std::isnan(val)) {
+            std::memcpy(out, "nan", 3);
+            return out + 3;
+        }
+        if (val < 0) {
+            *out++ = '-';
+        }
+        std::memcpy(out, "inf", 3);
+        return out + 3;
+    }
+
+    /// Writes the decimal digits of val, without leading zeros.
+    inline char *formatUnsigned(char *out, std::uint64_t val) {
+        char tmp[20];
+        char *p = tmp + sizeof(tmp);
+        do {
+            *--p = static_cast<char>('0' + val % 10);
+            val /= 10;
+        } while (val != 0);
+        const auto len = static_cast<std::size_t>(tmp + sizeof(tmp) - p);
+        std::memcpy(out, p, len);
+        return out + len;
+    }
+
+    /// @name Grisu2
+    /// Shortest digit generation after Florian Loitsch, "Printing
+    /// Floating-Point Numbers Quickly and Accurately with Integers" (PLDI
+    /// 2010). Grisu2 always produces digits that read back to the same
+    /// double, and in all but a tiny fraction of cases the shortest such.
+    /// @{
+
+    /// A "do-it-yourself" floating point number: f * 2^e.
+    struct DiyFp {
+        std::uint64_t f;
+        int e;
+    };
+
+    inline DiyFp sub(DiyFp x, DiyFp y) { return DiyFp{x.f - y.f, x.e}; }
+
+    /// Product, keeping the rounded upper 64 bits of the 128-bit result.
+    inline DiyFp mul(DiyFp x, DiyFp y) {
+        const std::uint64_t mask = 0xFFFFFFFFu;
+        const std::uint64_t a = x.f >> 32, b = x.f & mask;
+        const std::uint64_t c = y.f >> 32, d = y.f & mask;
+        const std::uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        std::uint64_t mid = (bd >> 32) + (ad & mask) + (bc & mask);
+        mid += std::uint64_t(1) << 31; // round
+        return DiyFp{ac + (ad >> 32) + (bc >> 32) + (mid >> 32),
+                     x.e + y.e + 64};
+    }
+
+    inline DiyFp normalize(DiyFp x) {
+        while ((x.f >> 63) == 0) {
+            x.f <<= 1;
+            x.e--;
+        }
+        return x;
+    }
+
+    /// The value, and the midpoints to its neighbors, sharing an exponent.
+    struct Boundaries {
+        DiyFp w;
+        DiyFp minus;
+        DiyFp plus;
+    };
+
+    /// val must be finite and positive.
+    inline Boundaries computeBoundaries(double val) {
+        static const int EXPONENT_BIAS = 1023 + 52;
+        static const std::uint64_t HIDDEN_BIT = std::uint64_t(1) << 52;
+        std::uint64_t bits;
+        std::memcpy(&bits, &val, sizeof(bits));
+        const int biasedExp = static_cast<int>(bits >> 52);
+        const std::uint64_t fraction = bits & (HIDDEN_BIT - 1);
+        const DiyFp v = biasedExp == 0
+                            ? DiyFp{fraction, 1 - EXPONENT_BIAS}
+                            : DiyFp{fraction + HIDDEN_BIT,
+                                    biasedExp - EXPONENT_BIAS};
+        /// At a power of two, the neighbor below is twice as close.
+        const bool lowerIsCloser = fraction == 0 && biasedExp > 1;
+        const DiyFp plus = normalize(DiyFp{2 * v.f + 1, v.e - 1});
+        DiyFp minus = lowerIsCloser ? DiyFp{4 * v.f - 1, v.e - 2}
+                                    : DiyFp{2 * v.f - 1, v.e - 1};
+        minus.f <<= (minus.e - plus.e);
+        minus.e = plus.e;
+        return Boundaries{normalize(v), minus, plus};
+    }
+
+    struct CachedPower {
+        std::uint64_t f;
+        int e;
+        int k;
+    };
+
+    /// Exponent window the scaled boundaries must land in, so the integral
+    /// part fits in 32 bits.
+    static const int ALPHA = -60;
+    static const int GAMMA = -32;
+
+    /// Normalized 10^k for k = -300, -292, ..., 324: each step of 8 decimal
+    /// exponents is smaller than the width of the [ALPHA, GAMMA] window.
+    inline CachedPower getCachedPower(int e) {
+        static const CachedPower powers[] = {
+            {0xAB70FE17C79AC6CA, -1060, -300},
+            {0xFF77B1FCBEBCDC4F, -1034, -292},
+            {0xBE5691EF416BD60C, -1007, -284},
+            {0x8DD01FAD907FFC3C, -980, -276},
+            {0xD3515C2831559A83, -954, -268},
+            {0x9D71AC8FADA6C9B5, -927, -260},
+            {0xEA9C227723EE8BCB, -901, -252},
+            {0xAECC49914078536D, -874, -244},
+            {0x823C12795DB6CE57, -847, -236},
+            {0xC21094364DFB5637, -821, -228},
+            {0x9096EA6F3848984F, -794, -220},
+            {0xD77485CB25823AC7, -768, -212},
+            {0xA086CFCD97BF97F4, -741, -204},
+            {0xEF340A98172AACE5, -715, -196},
+            {0xB23867FB2A35B28E, -688, -188},
+            {0x84C8D4DFD2C63F3B, -661, -180},
+            {0xC5DD44271AD3CDBA, -635, -172},
+            {0x936B9FCEBB25C996, -608, -164},
+            {0xDBAC6C247D62A584, -582, -156},
+            {0xA3AB66580D5FDAF6, -555, -148},
+            {0xF3E2F893DEC3F126, -529, -140},
+            {0xB5B5ADA8AAFF80B8, -502, -132},
+            {0x87625F056C7C4A8B, -475, -124},
+            {0xC9BCFF6034C13053, -449, -116},
+            {0x964E858C91BA2655, -422, -108},
+            {0xDFF9772470297EBD, -396, -100},
+            {0xA6DFBD9FB8E5B88F, -369, -92},
+            {0xF8A95FCF88747D94, -343, -84},
+            {0xB94470938FA89BCF, -316, -76},
+            {0x8A08F0F8BF0F156B, -289, -68},
+            {0xCDB02555653131B6, -263, -60},
+            {0x993FE2C6D07B7FAC, -236, -52},
+            {0xE45C10C42A2B3B06, -210, -44},
+            {0xAA242499697392D3, -183, -36},
+            {0xFD87B5F28300CA0E, -157, -28},
+            {0xBCE5086492111AEB, -130, -20},
+            {0x8CBCCC096F5088CC, -103, -12},
+            {0xD1B71758E219652C, -77, -4},
+            {0x9C40000000000000, -50, 4},
+            {0xE8D4A51000000000, -24, 12},
+            {0xAD78EBC5AC620000, 3, 20},
+            {0x813F3978F8940984, 30, 28},
+            {0xC097CE7BC90715B3, 56, 36},
+            {0x8F7E32CE7BEA5C70, 83, 44},
+            {0xD5D238A4ABE98068, 109, 52},
+            {0x9F4F2726179A2245, 136, 60},
+            {0xED63A231D4C4FB27, 162, 68},
+            {0xB0DE65388CC8ADA8, 189, 76},
+            {0x83C7088E1AAB65DB, 216, 84},
+            {0xC45D1DF942711D9A, 242, 92},
+            {0x924D692CA61BE758, 269, 100},
+            {0xDA01EE641A708DEA, 295, 108},
+            {0xA26DA3999AEF774A, 322, 116},
+            {0xF209787BB47D6B85, 348, 124},
+            {0xB454E4A179DD1877, 375, 132},
+            {0x865B86925B9BC5C2, 402, 140},
+            {0xC83553C5C8965D3D, 428, 148},
+            {0x952AB45CFA97A0B3, 455, 156},
+            {0xDE469FBD99A05FE3, 481, 164},
+            {0xA59BC234DB398C25, 508, 172},
+            {0xF6C69A72A3989F5C, 534, 180},
+            {0xB7DCBF5354E9BECE, 561, 188},
+            {0x88FCF317F22241E2, 588, 196},
+            {0xCC20CE9BD35C78A5, 614, 204},
+            {0x98165AF37B2153DF, 641, 212},
+            {0xE2A0B5DC971F303A, 667, 220},
+            {0xA8D9D1535CE3B396, 694, 228},
+            {0xFB9B7CD9A4A7443C, 720, 236},
+            {0xBB764C4CA7A44410, 747, 244},
+            {0x8BAB8EEFB6409C1A, 774, 252},
+            {0xD01FEF10A657842C, 800, 260},
+            {0x9B10A4E5E9913129, 827, 268},
+            {0xE7109BFBA19C0C9D, 853, 276},
+            {0xAC2820D9623BF429, 880, 284},
+            {0x80444B5E7AA7CF85, 907, 292},
+            {0xBF21E44003ACDD2D, 933, 300},
+            {0x8E679C2F5E44FF8F, 960, 308},
+            {0xD433179D9C8CB841, 986, 316},
+            {0x9E19DB92B4E31BA9, 1013, 324},
+        };
+        static const int MIN_DECIMAL_EXPONENT = -300;
+        static const int DECIMAL_EXPONENT_STEP = 8;
+        /// k = ceil((ALPHA - e - 1) * log10(2)), in fixed point.
+        const int f = ALPHA - e - 1;
+        const int k = (f * 78913) / (1 << 18) + static_cast<int>(f > 0);
+        const int index = (k - MIN_DECIMAL_EXPONENT + DECIMAL_EXPONENT_STEP -
+                           1) /
+                          DECIMAL_EXPONENT_STEP;
+        return powers[index];
+    }
+
+    /// Largest power of ten <= n (n > 0), and how many digits n has.
+    inline int largestPowerOfTen(std::uint32_t n, std::uint32_t &pow10) {
+        int digits = 10;
+        pow10 = 1000000000u;
+        while (pow10 > n) {
+            pow10 /= 10;
+            --digits;
+        }
+        return digits;
+    }
+
+    /// Nudges the last digit down while that brings it closer to the exact
+    /// value and stays in range.
+    inline void roundLastDigit(char *buf, int len, std::uint64_t dist,
+                               std::uint64_t delta, std::uint64_t rest,
+                               std::uint64_t tenK) {
+        while (rest < dist && delta - rest >= tenK &&
+               (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+            buf[len - 1]--;
+            rest += tenK;
+        }
+    }
+
+    /// Generates the shortest digits in (low, high), as close to w as
+    /// possible. All three share an exponent in [ALPHA, GAMMA].
+    inline void generateDigits(char *buf, int &len, int &decimalExponent,
+                               DiyFp low, DiyFp w, DiyFp high) {
+        std::uint64_t delta = sub(high, low).f;
+        std::uint64_t dist = sub(high, w).f;
+        const DiyFp one{std::uint64_t(1) << -high.e, high.e};
+        auto p1 = static_cast<std::uint32_t>(high.f >> -one.e);
+        std::uint64_t p2 = high.f & (one.f - 1);
+
+        std::uint32_t pow10;
+        int n = largestPowerOfTen(p1, pow10);
+        while (n > 0) {
+            buf[len++] = static_cast<char>('0' + p1 / pow10);
+            p1 %= pow10;
+            --n;
+            const std::uint64_t rest = (std::uint64_t(p1) << -one.e) + p2;
+            if (rest <= delta) {
+                decimalExponent += n;
+                roundLastDigit(buf, len, dist, delta, rest,
+                               std::uint64_t(pow10) << -one.e);
+                return;
+            }
+            pow10 /= 10;
+        }
+        int m = 0;
+        for (;;) {
+            p2 *= 10;
+            buf[len++] = static_cast<char>('0' + (p2 >> -one.e));
+            p2 &= one.f - 1;
+            ++m;
+            delta *= 10;
+            dist *= 10;
+            if (p2 <= delta) {
+                break;
+            }
+        }
+        decimalExponent -= m;
+        roundLastDigit(buf, len, dist, delta, p2, one.f);
+    }
+
+    /// Digits of val (finite, positive) into buf, such that
+    /// val ~= digits * 10^decimalExponent.
+    inline void grisu2(char *buf, int &len, int &decimalExponent, double val) {
+        const Boundaries b = computeBoundaries(val);
+        const CachedPower cached = getCachedPower(b.plus.e);
+        const DiyFp c{cached.f, cached.e};
+        const DiyFp w = mul(b.w, c);
+        DiyFp low = mul(b.minus, c);
+        DiyFp high = mul(b.plus, c);
+        /// Shrink by one unit each side to stay safely inside after the
+        /// rounding errors of the multiplication.
+        low.f++;
+        high.f--;
+        len = 0;
+        decimalExponent = -cached.k;
+        generateDigits(buf, len, decimalExponent, low, w, high);
+    }
+    /// @}
+
+    /// Lays out len digits with a decimal exponent: plain notation for
+    /// moderate magnitudes, otherwise d.ddde+XX like printf. buf must have
+    /// MAX_FORMATTED_LENGTH bytes.
+    inline char *layoutDigits(char *buf, int len, int decimalExponent) {
+        static const int MIN_PLAIN_EXPONENT = -4;
+        static const int MAX_PLAIN_EXPONENT = 15;
+        /// position of the decimal point relative to the first digit.
+        const int n = len + decimalExponent;
+        if (len <= n && n <= MAX_PLAIN_EXPONENT) {
+            // digits, then zeros: 12300
+            std::memset(buf + len, '0', static_cast<std::size_t>(n - len));
+            return buf + n;
+        }
+        if (0 < n && n <= MAX_PLAIN_EXPONENT) {
+            // 12.34
+            std::memmove(buf + n + 1, buf + n,
+                         static_cast<std::size_t>(len - n));
+            buf[n] = '.';
+            return buf + len + 1;
+        }
+        if (MIN_PLAIN_EXPONENT < n && n <= 0) {
+            // 0.001234
+            const int zeros = -n;
+            std::memmove(buf + 2 + zeros, buf, static_cast<std::size_t>(len));
+            buf[0] = '0';
+            buf[1] = '.';
+            std::memset(buf + 2, '0', static_cast<std::size_t>(zeros));
+            return buf + 2 + zeros + len;
+        }
+        // 1.234e+56
+        if (len > 1) {
+            std::memmove(buf + 2, buf + 1, static_cast<std::size_t>(len - 1));
+            buf[1] = '.';
+            buf += len + 1;
+        } else {
+            buf += 1;
+        }
+        *buf++ = 'e';
+        int exp = n - 1;
+        if (exp < 0) {
+            *buf++ = '-';
+            exp = -exp;
+        } else {
+            *buf++ = '+';
+        }
+        if (exp < 10) {
+            *buf++ = '0';
+        }
+        return formatUnsigned(buf, static_cast<std::uint64_t>(exp));
+    }
+} // namespace detail
+
+/// Writes the shortest text that reads back (with numparse::parse or strtod)
+/// as exactly val. Returns one past the last character written; out must
+/// have room for MAX_FORMATTED_LENGTH characters.
+inline char *formatShortest(char *out, double val) {
+    if (!std::isfinite(val)) {
+        return detail::formatNonFinite(out, val);
+    }
+    if (std::signbit(val)) {
+        *out++ = '-';
+        val = -val;
+    }
+    if (val == 0) {
+        *out++ = '0';
+        return out;
+    }
+    int len;
+    int decimalExponent;
+    detail::grisu2(out, len, decimalExponent, val);
+    return detail::layoutDigits(out, len, decimalExponent);
+}
+
+/// Writes val rounded to a fixed number of decimals (at most
+/// MAX_FIXED_DECIMALS), with the same digits as printf's "%.*f": rounded
+/// from val's exact value, ties to even. The one difference is that a value
+/// that rounds to zero is written without a minus sign. When val scaled by
+/// the power of ten is below 2^52, it's rounded with integer arithmetic;
+/// larger ones go through snprintf, and the shortest form is written if
+/// even that won't fit. Returns one past the last character written; out
+/// must have room for MAX_FORMATTED_LENGTH characters.
+inline char *formatFixed(char *out, double val, int decimals) {
+    static const std::uint64_t POW10[] = {1ull,
+                                          10ull,
+                                          100ull,
+                                          1000ull,
+                                          10000ull,
+                                          100000ull,
+                                          1000000ull,
+                                          10000000ull,
+                                          100000000ull,
+                                          1000000000ull,
+                                          10000000000ull,
+                                          100000000000ull,
+                                          1000000000000ull,
+                                          10000000000000ull,
+                                          100000000000000ull,
+                                          1000000000000000ull};
+    if (decimals < 0) {
+        decimals = 0;
+    } else if (decimals > MAX_FIXED_DECIMALS) {
+        decimals = MAX_FIXED_DECIMALS;
+    }
+    if (!std::isfinite(val)) {
+        return detail::formatNonFinite(out, val);
+    }
+    const double scale = static_cast<double>(POW10[decimals]);
+    const double scaled = std::fabs(val) * scale;
+    /// Below 2^52 the product keeps at least one bit after the point.
+    if (!(scaled < 4503599627370496.0)) {
+        auto len = std::snprintf(out, MAX_FORMATTED_LENGTH, "%.*f", decimals,
+                                 val);
+        if (len < 0 || static_cast<std::size_t>(len) >= MAX_FORMATTED_LENGTH) {
+            // Doesn't fit in our budget at all: fall back to shortest.
+            return formatShortest(out, val);
+        }
+        return out + len;
+    }
+    /// The product was rounded once, by at most half its ulp: too little to
+    /// move it from one side of a half to the other. Only one that came out
+    /// right on a half is in doubt.
+    auto units = static_cast<std::uint64_t>(scaled);
+    const double frac = scaled - static_cast<double>(units);
+    units += frac > 0.5;
+    if (frac == 0.5) {
+        /// What the rounding took off says which side of the half the exact
+        /// product is on - or that it's a tie.
+        const double error = std::fma(std::fabs(val), scale, -scaled);
+        if (error > 0 || (error == 0 && units % 2 != 0)) {
+            ++units;
+        }
+    }
+    if (std::signbit(val) && units != 0) {
+        *out++ = '-';
+    }
+    out = detail::formatUnsigned(out, units / POW10[decimals]);
+    if (decimals > 0) {
+        *out++ = '.';
+        std::uint64_t frac = units % POW10[decimals];
+        for (int i = decimals - 1; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + frac % 10);
+            frac /= 10;
+        }
+        out += decimals;
+    }
+    return out;
+}
+
+/// How to write doubles in output rows.
+struct DoubleFormat {
+    enum Mode { Shortest, Fixed };
+    Mode mode = Shortest;
+    /// Used in Fixed mode.
+    int decimals = 6;
+};
+
+inline char *format(char *out, double val, DoubleFormat const &fmt) {
+    return fmt.mode == DoubleFormat::Fixed ? formatFixed(out, val, fmt.decimals)
+                                           : formatShortest(out, val);
+}
+
+} // namespace numformat
+
+#endif // INCLUDED_NumericFormatting_h_GUID_58D1A6C3_4E7F_4B92_A0C8_E36F15B927D4
@@ -0,0 +1,295 @@
+/** @file
+    @brief Header providing locale-free parsers for integers and doubles that
+   work directly on character ranges, for use in place of istringstream.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_NumericParsing_h_GUID_3C5E1B7A_8D42_4F0E_9A61_2B7D4C90E815
+#define INCLUDED_NumericParsing_h_GUID_3C5E1B7A_8D42_4F0E_9A61_2B7D4C90E815
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+namespace numparse {
+
+namespace detail {
+    inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    /// Narrows [first, last) by dropping surrounding spaces and tabs, which
+    /// is as lenient as the stream extraction we replace.
+    inline void trim(const char *&first, const char *&last) {
+        while (first != last && isSpace(*first)) {
+            ++first;
+        }
+        while (first != last && isSpace(*(last - 1))) {
+            --last;
+        }
+    }
+
+    /// Powers of ten exactly representable as a double.
+    inline double exactPowerOfTen(int e) {
+        static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                        1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                        1e18, 1e19, 1e20, 1e21, 1e22};
+        return powers[e];
+    }
+    static const int MAX_EXACT_POWER_OF_TEN = 22;
+    static const std::uint64_t MAX_EXACT_MANTISSA = std::uint64_t(1) << 53;
+
+    /// Slow but correctly-rounded path: hands a NUL-terminated copy to
+    /// strtod. The tool never calls setlocale, so this runs in the "C"
+    /// locale and agrees with the fast path on the decimal point.
+    inline bool parseDoubleFallback(const char *first, const char *last,
+                                    double &out) {
+        static const std::size_t BUFSIZE = 64;
+        const auto len = static_cast<std::size_t>(last - first);
+        char buf[BUFSIZE];
+        std::string longBuf;
+        const char *str = buf;
+        if (len < BUFSIZE) {
+            std::copy(first, last, buf);
+            buf[len] = '\0';
+        } else {
+            longBuf.assign(first, last);
+            str = longBuf.c_str();
+        }
+        char *end = nullptr;
+        double val = std::strtod(str, &end);
+        if (end != str + len) {
+            return false;
+        }
+        out = val;
+        return true;
+    }
+} // namespace detail
+
+/// Parses a whole decimal integer field (optionally signed, optionally
+/// surrounded by spaces). Returns false, leaving out untouched, on malformed
+/// input or if the value does not fit in T.
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value, bool>::type
+parse(const char *first, const char *last, T &out) {
+    detail::trim(first, last);
+    bool negative = false;
+    if (first != last && (*first == '-' || *first == '+')) {
+        negative = (*first == '-');
+        ++first;
+    }
+    if (first == last) {
+        return false;
+    }
+    if (negative && !std::is_signed<T>::value) {
+        return false;
+    }
+    /// Magnitude limit: one more for negative values of signed types.
+    const std::uint64_t limit =
+        static_cast<std::uint64_t>(std::numeric_limits<T>::max()) +
+        (negative ? 1 : 0);
+    std::uint64_t val = 0;
+    for (; first != last; ++first) {
+        if (!detail::isDigit(*first)) {
+            return false;
+        }
+        const std::uint64_t digit = static_cast<std::uint64_t>(*first - '0');
+        if (val > (limit - digit) / 10) {
+            return false;
+        }
+        val = val * 10 + digit;
+    }
+    if (negative) {
+        /// Two's complement negation of the magnitude, valid down to min().
+        out = static_cast<T>(0 - val);
+    } else {
+        out = static_cast<T>(val);
+    }
+    return true;
+}
+
+/// Parses a decimal field that may have a fractional part (optionally
+/// signed, optionally surrounded by spaces) as a whole number of units of
+/// 10^-decimals: "12.5" with 3 decimals is 12500. Digits past the last of
+/// those are dropped. Returns false, leaving out untouched, on malformed
+/// input or if the value does not fit.
+inline bool parseScaled(const char *first, const char *last, int decimals,
+                        std::int64_t &out) {
+    detail::trim(first, last);
+    bool negative = false;
+    if (first != last && (*first == '-' || *first == '+')) {
+        negative = (*first == '-');
+        ++first;
+    }
+    const std::uint64_t limit =
+        static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) +
+        (negative ? 1 : 0);
+    std::uint64_t val = 0;
+    bool anyDigits = false;
+    /// Digits kept after the point so far, or -1 before the point.
+    int fraction = -1;
+    for (; first != last; ++first) {
+        if (*first == '.' && fraction < 0) {
+            fraction = 0;
+            continue;
+        }
+        if (!detail::isDigit(*first)) {
+            return false;
+        }
+        anyDigits = true;
+        if (fraction >= decimals) {
+            continue;
+        }
+        if (fraction >= 0) {
+            ++fraction;
+        }
+        const std::uint64_t digit = static_cast<std::uint64_t>(*first - '0');
+        if (val > (limit - digit) / 10) {
+            return false;
+        }
+        val = val * 10 + digit;
+    }
+    if (!anyDigits) {
+        return false;
+    }
+    for (int i = fraction < 0 ? 0 : fraction; i < decimals; ++i) {
+        if (val > limit / 10) {
+            return false;
+        }
+        val *= 10;
+    }
+    out = negative ? static_cast<std::int64_t>(0 - val)
+                   : static_cast<std::int64_t>(val);
+    return true;
+}
+
+/// Parses a whole decimal floating-point field, with the same result
+/// (correctly rounded to nearest) as strtod in the "C" locale. Inputs with at
+/// most 19 significant digits and a small decimal exponent - every number our
+/// trackers write - are converted exactly with a single multiply or divide by
+/// a power of ten (Clinger's fast path); anything else falls back to strtod.
+inline bool parse(const char *first, const char *last, double &out) {
+    detail::trim(first, last);
+    const char *const start = first;
+    bool negative = false;
+    if (first != last && (*first == '-' || *first == '+')) {
+        negative = (*first == '-');
+        ++first;
+    }
+    std::uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int exp10 = 0;
+    bool anyDigits = false;
+    bool truncated = false;
+    auto consumeDigit = [&](char c, bool fractional) {
+        anyDigits = true;
+        if (mantissa == 0 && c == '0') {
+            // leading zeros are not significant
+            if (fractional) {
+                --exp10;
+            }
+            return;
+        }
+        if (significantDigits < 19) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(c - '0');
+            ++significantDigits;
+            if (fractional) {
+                --exp10;
+            }
+        } else {
+            truncated = true;
+            if (!fractional) {
+                ++exp10;
+            }
+        }
+    };
+    for (; first != last && detail::isDigit(*first); ++first) {
+        consumeDigit(*first, false);
+    }
+    if (first != last && *first == '.') {
+        ++first;
+        for (; first != last && detail::isDigit(*first); ++first) {
+            consumeDigit(*first, true);
+        }
+    }
+    if (!anyDigits) {
+        /// Blank, or not a number at all: std::istream never took inf or
+        /// nan either.
+        return false;
+    }
+    if (first != last && (*first == 'e' || *first == 'E')) {
+        ++first;
+        bool negativeExp = false;
+        if (first != last && (*first == '-' || *first == '+')) {
+            negativeExp = (*first == '-');
+            ++first;
+        }
+        if (first == last) {
+            return false;
+        }
+        int e = 0;
+        for (; first != last; ++first) {
+            if (!detail::isDigit(*first)) {
+                return false;
+            }
+            if (e < 100000) {
+                e = e * 10 + (*first - '0');
+            }
+        }
+        exp10 += negativeExp ? -e : e;
+    }
+    if (first != last) {
+        return false;
+    }
+#if FLT_EVAL_METHOD == 0
+    /// Only exact when intermediate results are rounded to double, which is
+    /// not the case with x87 extended precision.
+    if (!truncated && mantissa <= detail::MAX_EXACT_MANTISSA &&
+        exp10 >= -detail::MAX_EXACT_POWER_OF_TEN &&
+        exp10 <= detail::MAX_EXACT_POWER_OF_TEN) {
+        double val = static_cast<double>(mantissa);
+        if (exp10 < 0) {
+            val /= detail::exactPowerOfTen(-exp10);
+        } else {
+            val *= detail::exactPowerOfTen(exp10);
+        }
+        out = negative ? -val : val;
+        return true;
+    }
+#endif
+    return detail::parseDoubleFallback(start, last, out);
+}
+
+} // namespace numparse
+
+#endif // INCLUDED_NumericParsing_h_GUID_3C5E1B7A_8D42_4F0E_9A61_2B7D4C90E815
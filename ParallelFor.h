@@ -0,0 +1,86 @@
+/** @file
+    @brief Header providing a minimal way to run a loop's iterations on a
+   handful of threads.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_ParallelFor_h_GUID_98CB6E10_50E4_4308_BE3B_4E980F336B90
+#define INCLUDED_ParallelFor_h_GUID_98CB6E10_50E4_4308_BE3B_4E980F336B90
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+/// Number of threads to use when asked for 0: one per core.
+inline std::size_t defaultThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/// Calls fn(i) for each i in [0, n), spread over up to the given number of
+/// threads (the calling thread being one of them), which take the next
+/// index as they finish the last. Returns once all calls have; the first
+/// exception thrown, if any, is rethrown then.
+template <typename F>
+inline void forEachIndex(std::size_t n, std::size_t threads, F fn) {
+    std::atomic<std::size_t> next{0};
+    std::vector<std::exception_ptr> errors(std::max<std::size_t>(threads, 1));
+    auto work = [&](std::size_t worker) {
+        try {
+            for (auto i = next++; i < n; i = next++) {
+                fn(i);
+            }
+        } catch (...) {
+            errors[worker] = std::current_exception();
+            // nobody else needs to start anything new.
+            next = n;
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (std::size_t w = 1; w < threads && w < n; ++w) {
+        helpers.emplace_back(work, w);
+    }
+    work(0);
+    for (auto &t : helpers) {
+        t.join();
+    }
+    for (auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+} // namespace parallel
+
+#endif // INCLUDED_ParallelFor_h_GUID_98CB6E10_50E4_4308_BE3B_4E980F336B90
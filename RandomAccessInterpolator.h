@@ -0,0 +1,250 @@
+/** @file
+    @brief Header providing an interpolation engine that answers queries for
+   arbitrary, unordered timestamps from an indexed store of tracker samples.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_RandomAccessInterpolator_h_GUID_F08B3D62_9C4A_4E17_B5D0_6A2E8F71C39D
+#define INCLUDED_RandomAccessInterpolator_h_GUID_F08B3D62_9C4A_4E17_B5D0_6A2E8F71C39D
+
+// Internal Includes
+#include "Instrumentation.h"
+#include "MotionSynthesizer.h"
+#include "Slerp.h"
+#include "TrackerSource.h"
+#include "TrackerStore.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace motionsynth {
+
+/// Interpolates at any timestamp, in any order, from a store of samples.
+/// Finding the interval starts from a guess based on the average sample
+/// spacing and gallops out from there, so lookups are O(1) for evenly spaced
+/// tracker data and O(log n) at worst.
+class RandomAccessInterpolator {
+  public:
+    explicit RandomAccessInterpolator(TrackerStore const &store)
+        : store_(store) {
+        if (store_.size() < 2) {
+            throw std::runtime_error("Need at least two rows of tracker data "
+                                     "to interpolate!");
+        }
+        if (!store_.isSorted()) {
+            throw std::runtime_error("Tracker data timestamps must not go "
+                                     "backwards!");
+        }
+        auto const &t = store_.timestamps();
+        const auto span = t.back() - t.front();
+        intervalsPerNanosecond_ =
+            span > 0 ? static_cast<double>(t.size() - 1) / span : 0.;
+    }
+
+    Status operator()(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                      Eigen::Quaterniond &outRot) const {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(Interpolation);
+        MOTIONSYNTH_INSTRUMENT_COUNT(Queries, 1);
+        return interpolate(tv, outXlate, outRot);
+    }
+
+    Status interpolate(Nanoseconds tv, Eigen::Vector3d &outXlate,
+                       Eigen::Quaterniond &outRot) const {
+        auto const &t = store_.timestamps();
+        if (tv < t.front()) {
+            return Status::BeforeRecordedTrackerData;
+        }
+        if (tv > t.back()) {
+            return Status::AfterRecordedTrackerData;
+        }
+        if (tv == t.back()) {
+            /// right on the last sample.
+            outXlate = store_.xlate(t.size() - 1);
+            outRot = store_.rot(t.size() - 1);
+            return Status::Successful;
+        }
+        interpolateInInterval(findInterval(tv), tv, outXlate, outRot);
+        return Status::Successful;
+    }
+
+    /// Batch form of operator(), in any order: status[i] says whether the
+    /// pose for tvs[i] was stored at index i of out. Each query first tries
+    /// the interval of the one before it, so the search is only done when a
+    /// query moves to another interval. Rotations are gathered up a chunk at
+    /// a time for the slerp kernel.
+    void interpolate(Nanoseconds const *tvs, std::size_t n,
+                     PoseArrays const &out, Status *status) const {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(Interpolation);
+        MOTIONSYNTH_INSTRUMENT_COUNT(Queries, n);
+        static const std::size_t CHUNK = 64;
+        auto const &t = store_.timestamps();
+        const auto last = t.size() - 1;
+        std::size_t i = 0;
+        double q0[4][CHUNK];
+        double q1[4][CHUNK];
+        double frac[CHUNK];
+        bool exact[CHUNK];
+        for (std::size_t begin = 0; begin < n; begin += CHUNK) {
+            const auto m = std::min(CHUNK, n - begin);
+            for (std::size_t k = 0; k < m; ++k) {
+                const auto q = begin + k;
+                const auto tv = tvs[q];
+                /// Interval ends for this query: the same sample for an
+                /// exact hit (copied over the slerp result after), and the
+                /// identity for no result at all.
+                std::size_t from = 0;
+                std::size_t to = 0;
+                frac[k] = 0;
+                exact[k] = false;
+                if (tv < t.front()) {
+                    out.storeRange(q, t.front(), t.back());
+                    status[q] = Status::BeforeRecordedTrackerData;
+                } else if (tv > t.back()) {
+                    out.storeRange(q, t.front(), t.back());
+                    status[q] = Status::AfterRecordedTrackerData;
+                } else {
+                    if (tv == t.back()) {
+                        from = to = last;
+                    } else {
+                        if (!(t[i] <= tv && tv < t[i + 1])) {
+                            i = findInterval(tv);
+                        }
+                        from = i;
+                        to = tv == t[i] ? i : i + 1;
+                        if (to != from) {
+                            frac[k] = static_cast<double>(tv - t[i]) *
+                                      perNanosecond(t[i + 1] - t[i]);
+                        }
+                    }
+                    exact[k] = to == from;
+                    const auto startXlate = store_.xlate(from);
+                    const Eigen::Vector3d xlate =
+                        startXlate +
+                        frac[k] * (store_.xlate(to) - startXlate);
+                    out.x[q] = xlate.x();
+                    out.y[q] = xlate.y();
+                    out.z[q] = xlate.z();
+                    status[q] = Status::Successful;
+                }
+                const auto r0 = status[q] == Status::Successful
+                                    ? store_.rot(from)
+                                    : Eigen::Quaterniond::Identity();
+                const auto r1 = status[q] == Status::Successful
+                                    ? store_.rot(to)
+                                    : Eigen::Quaterniond::Identity();
+                q0[0][k] = r0.w();
+                q0[1][k] = r0.x();
+                q0[2][k] = r0.y();
+                q0[3][k] = r0.z();
+                q1[0][k] = r1.w();
+                q1[1][k] = r1.x();
+                q1[2][k] = r1.y();
+                q1[3][k] = r1.z();
+            }
+            slerp::ConstQuatArrays starts = {q0[0], q0[1], q0[2], q0[3]};
+            slerp::ConstQuatArrays ends = {q1[0], q1[1], q1[2], q1[3]};
+            slerp::QuatArrays rots = {out.qw + begin, out.qx + begin,
+                                      out.qy + begin, out.qz + begin};
+            slerp::interpolate(starts, ends, frac, m, rots);
+            for (std::size_t k = 0; k < m; ++k) {
+                if (exact[k]) {
+                    out.qw[begin + k] = q0[0][k];
+                    out.qx[begin + k] = q0[1][k];
+                    out.qy[begin + k] = q0[2][k];
+                    out.qz[begin + k] = q0[3][k];
+                }
+            }
+        }
+    }
+
+    Nanoseconds getStartTime() const { return store_.timestamps().front(); }
+    Nanoseconds getEndTime() const { return store_.timestamps().back(); }
+
+  private:
+    /// Pose at tv, given t[i] <= tv < t[i + 1].
+    void interpolateInInterval(std::size_t i, Nanoseconds tv,
+                               Eigen::Vector3d &outXlate,
+                               Eigen::Quaterniond &outRot) const {
+        auto const &t = store_.timestamps();
+        if (tv == t[i]) {
+            /// right on the start.
+            outXlate = store_.xlate(i);
+            outRot = store_.rot(i);
+            return;
+        }
+        const auto startXlate = store_.xlate(i);
+        const auto frac = static_cast<double>(tv - t[i]) *
+                          perNanosecond(t[i + 1] - t[i]);
+        interpolatePose(frac, startXlate, store_.xlate(i + 1) - startXlate,
+                        store_.rot(i), store_.rot(i + 1), outXlate, outRot);
+    }
+
+    /// Index i such that t[i] <= tv < t[i + 1]: tv must be at least the
+    /// first timestamp and less than the last.
+    std::size_t findInterval(Nanoseconds tv) const {
+        auto const &t = store_.timestamps();
+        const auto n = t.size();
+        auto guess = static_cast<std::size_t>(
+            static_cast<double>(tv - t.front()) * intervalsPerNanosecond_);
+        guess = std::min(guess, n - 2);
+        std::size_t lo;
+        std::size_t hi;
+        if (t[guess] <= tv) {
+            // gallop forward: t[lo] <= tv, and t[hi] > tv if hi < n
+            lo = guess;
+            std::size_t step = 1;
+            hi = lo + step;
+            while (hi < n && t[hi] <= tv) {
+                lo = hi;
+                step *= 2;
+                hi = lo + step;
+            }
+            hi = std::min(hi, n);
+        } else {
+            // gallop backward: t[hi] > tv, and t[lo] <= tv
+            hi = guess;
+            std::size_t step = 1;
+            lo = hi > step ? hi - step : 0;
+            while (lo > 0 && t[lo] > tv) {
+                hi = lo;
+                step *= 2;
+                lo = hi > step ? hi - step : 0;
+            }
+        }
+        auto it = std::upper_bound(t.begin() + lo, t.begin() + hi, tv);
+        return static_cast<std::size_t>(it - t.begin()) - 1;
+    }
+
+    TrackerStore const &store_;
+    double intervalsPerNanosecond_;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_RandomAccessInterpolator_h_GUID_F08B3D62_9C4A_4E17_B5D0_6A2E8F71C39D
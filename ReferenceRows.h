@@ -0,0 +1,332 @@
+/** @file
+    @brief Header providing the batches that reference rows are read,
+   interpolated and written in, and the code to fill and write them.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_ReferenceRows_h_GUID_3591C77C_6572_465D_812A_7F3692821DDD
+#define INCLUDED_ReferenceRows_h_GUID_3591C77C_6572_465D_812A_7F3692821DDD
+
+// Internal Includes
+#include "CSVTools.h"
+#include "Instrumentation.h"
+#include "LineSource.h"
+#include "MotionSynthesizer.h"
+#include "NumericFormatting.h"
+#include "NumericParsing.h"
+#include "RowDiagnostics.h"
+#include "TrackerSource.h"
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace motionsynth {
+
+/// Number of fields at the start of a reference row making up its
+/// timestamp: sec, usec.
+static const std::size_t NUM_TIMESTAMP_FIELDS = 2;
+
+template <typename Output>
+inline void writeDouble(Output &output, double val,
+                        numformat::DoubleFormat const &fmt) {
+    auto buf = output.prepare(numformat::MAX_FORMATTED_LENGTH);
+    auto end = numformat::format(buf, val, fmt);
+    output.commit(static_cast<std::size_t>(end - buf));
+}
+
+/// A batch of reference rows waiting to be interpolated: their timestamps,
+/// their text (copied, since a line source may reuse its buffer), and room
+/// for the poses and statuses.
+class ReferenceBatch {
+  public:
+    static const std::size_t CAPACITY = 1024;
+
+    /// Why filling the batch stopped short of full, if it did.
+    enum class Stop { NotStopped, OutOfRows, BadRow };
+
+    ReferenceBatch() {
+        tvs_.reserve(CAPACITY);
+        lineEnds_.reserve(CAPACITY);
+        for (auto &col : poseCols_) {
+            col.resize(CAPACITY);
+        }
+        status_.resize(CAPACITY);
+        rangeStarts_.resize(CAPACITY);
+        rangeEnds_.resize(CAPACITY);
+    }
+
+    std::size_t size() const { return tvs_.size(); }
+    bool full() const { return size() == CAPACITY; }
+    void clear() {
+        tvs_.clear();
+        text_.clear();
+        lineEnds_.clear();
+        stop_ = Stop::NotStopped;
+        badLine_.clear();
+        badFieldCount_ = 0;
+    }
+    void add(Nanoseconds tv, csvtools::StringRef line) {
+        tvs_.push_back(tv);
+        text_.insert(text_.end(), line.begin(), line.end());
+        lineEnds_.push_back(text_.size());
+    }
+
+    /// @name Stopping short
+    /// @{
+    void stopOutOfRows() { stop_ = Stop::OutOfRows; }
+    void stopAtBadRow(csvtools::StringRef line, std::size_t fieldCount) {
+        stop_ = Stop::BadRow;
+        badLine_ = line.str();
+        badFieldCount_ = fieldCount;
+    }
+    Stop stop() const { return stop_; }
+    bool stopped() const { return stop_ != Stop::NotStopped; }
+    std::string const &badLine() const { return badLine_; }
+    std::size_t badFieldCount() const { return badFieldCount_; }
+    /// @}
+
+    /// Interpolates every row in the batch.
+    template <typename Engine> void interpolate(Engine &app) {
+        motionsynth::PoseArrays out = {
+            poseCols_[0].data(), poseCols_[1].data(), poseCols_[2].data(),
+            poseCols_[3].data(), poseCols_[4].data(), poseCols_[5].data(),
+            poseCols_[6].data(), rangeStarts_.data(), rangeEnds_.data()};
+        app.interpolate(tvs_.data(), size(), out, status_.data());
+    }
+
+    Nanoseconds timestamp(std::size_t i) const { return tvs_[i]; }
+    csvtools::StringRef line(std::size_t i) const {
+        auto begin = i == 0 ? 0 : lineEnds_[i - 1];
+        return csvtools::StringRef(text_.data() + begin,
+                                   lineEnds_[i] - begin);
+    }
+    Status status(std::size_t i) const { return status_[i]; }
+    /// Component c (x, y, z, qw, qx, qy, qz) of the pose for row i.
+    double pose(std::size_t i, std::size_t c) const { return poseCols_[c][i]; }
+
+    /// For a row found to be outside the tracker data, the engine's range
+    /// of it right then, for messages.
+    Nanoseconds rangeStart(std::size_t i) const { return rangeStarts_[i]; }
+    Nanoseconds rangeEnd(std::size_t i) const { return rangeEnds_[i]; }
+
+    static const std::size_t POSE_COMPONENTS = 7;
+
+  private:
+    std::vector<Nanoseconds> tvs_;
+    std::vector<char> text_;
+    std::vector<std::size_t> lineEnds_;
+    std::vector<double> poseCols_[POSE_COMPONENTS];
+    std::vector<Status> status_;
+    Stop stop_ = Stop::NotStopped;
+    std::string badLine_;
+    std::size_t badFieldCount_ = 0;
+    std::vector<Nanoseconds> rangeStarts_;
+    std::vector<Nanoseconds> rangeEnds_;
+};
+
+/// Offset of the first reference row in [begin, end) of data timestamped at
+/// or after tv, found by a binary search by byte offset so only about
+/// log2(end - begin) rows get parsed. The rows must be in time order; one
+/// without a timestamp stops the search there.
+inline std::size_t firstRowAtOrAfter(const char *data, std::size_t begin,
+                                     std::size_t end, Nanoseconds tv) {
+    csvtools::FieldSpans spans;
+    auto timestampOf = [&](csvtools::StringRef line, Nanoseconds &key) {
+        return parseTimestamp(line, spans, key);
+    };
+    /// Find the last row before tv: the answer is the one after it, unless
+    /// there's no such row and this is the first.
+    auto pos = csvtools::findLastLineNotAfter(
+        data, begin, end, tv - 1, timestampOf);
+    csvtools::MappedLineSource lines(data, end);
+    lines.seek(pos);
+    csvtools::StringRef line;
+    Nanoseconds key = 0;
+    if (lines.getLine(line) && timestampOf(line, key) && key < tv) {
+        pos = lines.position();
+    }
+    return pos;
+}
+
+/// Clears the batch and reads reference rows into it until it's full (or
+/// has maxRows), out of rows or a row is bad.
+inline void fillBatch(csvtools::LineSource &timeRefLines,
+                      csvtools::FieldSpans &timestampFields,
+                      ReferenceBatch &batch,
+                      std::size_t maxRows = ReferenceBatch::CAPACITY) {
+    csvtools::StringRef data;
+    batch.clear();
+    while (!batch.full() && batch.size() < maxRows) {
+        if (!timeRefLines.getRow(data, timestampFields,
+                                 NUM_TIMESTAMP_FIELDS)) {
+            batch.stopOutOfRows();
+            break;
+        }
+        if (timestampFields.size() != NUM_TIMESTAMP_FIELDS) {
+            batch.stopAtBadRow(data, timestampFields.size());
+            break;
+        }
+        Nanoseconds tv = 0;
+        bool parsed = false;
+        {
+            MOTIONSYNTH_INSTRUMENT_SCOPE(NumericParsing);
+            parsed = parseTimestampFields(data, timestampFields, tv);
+        }
+        if (!parsed) {
+            batch.stopAtBadRow(data, timestampFields.size());
+            break;
+        }
+        batch.add(tv, data);
+    }
+    MOTIONSYNTH_INSTRUMENT_COUNT(ReferenceRows, batch.size());
+}
+
+/// Prints why the rows stopped coming, once they have, and the total count.
+inline void reportStop(ReferenceBatch::Stop stop, std::string const &badLine,
+                       std::size_t badFieldCount, std::uint64_t rows) {
+    switch (stop) {
+    case ReferenceBatch::Stop::OutOfRows:
+        std::cerr << "Out of time ref data, all done." << std::endl;
+        break;
+    case ReferenceBatch::Stop::BadRow:
+        if (badFieldCount < NUM_TIMESTAMP_FIELDS) {
+            std::cerr << "Got only " << badFieldCount << " fields, wanted "
+                      << NUM_TIMESTAMP_FIELDS << std::endl;
+        } else {
+            std::cerr << "Couldn't read a timestamp from the first "
+                      << NUM_TIMESTAMP_FIELDS << " fields" << std::endl;
+        }
+        std::cerr << "Line was '" << badLine << "'" << std::endl;
+        break;
+    default:
+        return;
+    }
+    std::cerr << "Rows: " << rows << std::endl;
+}
+
+/// Writes interpolated batches out in order, along with the messages about
+/// them, until one says we're done. Rows that couldn't be interpolated go to
+/// the diagnostics.
+template <typename Output> class BatchWriter {
+  public:
+    /// Unless announceStart is set, the first written row isn't announced
+    /// in the messages, just noted: see startedWritingAt().
+    BatchWriter(Output &output, numformat::DoubleFormat const &fmt,
+                RowDiagnostics &diagnostics,
+                std::ostream &messages = std::cout, bool announceStart = true)
+        : output_(output), fmt_(fmt), diagnostics_(diagnostics),
+          messages_(messages), announceStart_(announceStart) {}
+
+    /// Returns false once there's nothing more to write after this batch.
+    bool write(ReferenceBatch const &batch) {
+        const bool outOfData = !writeRows(batch);
+        if (outOfData || batch.stopped()) {
+            diagnostics_.finish();
+        }
+        if (outOfData) {
+            return false;
+        }
+        reportStop(batch.stop(), batch.badLine(), batch.badFieldCount(),
+                   rows_);
+        return !batch.stopped();
+    }
+
+    /// Just the rows of the batch and the messages about them: returns false
+    /// if out of tracker data.
+    bool writeRows(ReferenceBatch const &batch) {
+        MOTIONSYNTH_INSTRUMENT_SCOPE(OutputFormatting);
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            rows_++;
+            const auto status = batch.status(i);
+            diagnostics_.record(status, batch.timestamp(i),
+                                batch.rangeStart(i), batch.rangeEnd(i));
+            switch (status) {
+            case Status::BeforeRecordedTrackerData:
+            case Status::AfterRecordedTrackerData:
+                break;
+            case Status::Successful:
+            case Status::Extrapolated:
+                if (!startedWriting_) {
+                    startedWriting_ = true;
+                    if (announceStart_) {
+                        messages_ << "Starting to write data rows!"
+                                  << std::endl;
+                    } else {
+                        startedWritingAt_ =
+                            static_cast<std::size_t>(messages_.tellp());
+                    }
+                }
+                for (std::size_t c = 0; c < ReferenceBatch::POSE_COMPONENTS;
+                     ++c) {
+                    writeDouble(output_, batch.pose(i, c), fmt_);
+                    output_.put(csvtools::COMMA_CHAR);
+                }
+                if (flagExtrapolated_) {
+                    output_.put(status == Status::Extrapolated ? '1' : '0');
+                    output_.put(csvtools::COMMA_CHAR);
+                }
+                output_.write(batch.line(i));
+                output_.put('\n');
+                break;
+            case Status::OutOfData:
+                messages_ << "Out of data from the tracker." << std::endl;
+                return false;
+            default:
+                std::cerr << "Bad things happened!" << std::endl;
+                break;
+            }
+        }
+        return true;
+    }
+
+    /// Whether to write a column after the pose saying if it was
+    /// extrapolated: 1 if so, 0 if not.
+    void flagExtrapolated(bool flag) { flagExtrapolated_ = flag; }
+
+    std::uint64_t rows() const { return rows_; }
+    bool startedWriting() const { return startedWriting_; }
+    /// Position in the messages where the first row was written, when not
+    /// announcing it.
+    std::size_t startedWritingAt() const { return startedWritingAt_; }
+
+  private:
+    Output &output_;
+    numformat::DoubleFormat fmt_;
+    RowDiagnostics &diagnostics_;
+    std::ostream &messages_;
+    bool announceStart_;
+    bool flagExtrapolated_ = false;
+    std::uint64_t rows_ = 0;
+    bool startedWriting_ = false;
+    std::size_t startedWritingAt_ = 0;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_ReferenceRows_h_GUID_3591C77C_6572_465D_812A_7F3692821DDD
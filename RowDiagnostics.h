@@ -0,0 +1,264 @@
+/** @file
+    @brief Header providing aggregated, rate-limited reporting of the
+   reference rows that fall outside the tracker data.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_RowDiagnostics_h_GUID_FF472751_C389_4AF6_BE05_263EDD885564
+#define INCLUDED_RowDiagnostics_h_GUID_FF472751_C389_4AF6_BE05_263EDD885564
+
+// Internal Includes
+#include "MotionSynthesizer.h"
+#include "TrackerSource.h"
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace motionsynth {
+
+/// A run of consecutive reference rows that all got the same status.
+struct RowRun {
+    Status status = Status::Successful;
+    std::uint64_t count = 0;
+    Nanoseconds first = 0;
+    Nanoseconds last = 0;
+    /// The engine's tracker data range as of the last of them.
+    Nanoseconds rangeStart = 0;
+    Nanoseconds rangeEnd = 0;
+};
+
+/// Keeps count of the reference rows that couldn't be interpolated for being
+/// before or after the tracker data, and reports them as a summary line per
+/// side, instead of a line per row, which on big files took longer to print
+/// than the rows took to process. Rows extrapolated past it just get counted,
+/// for a line at the end.
+///
+/// A summary goes out when a run of such rows ends, or every so often while
+/// one goes on, but never more than once per interval; whatever's left, and
+/// the totals if they took more than one summary, go out on finish().
+///
+/// Made without a stream, it just collects the runs instead, to be add()ed
+/// to one that reports them, in order, later.
+class RowDiagnostics {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit RowDiagnostics(std::ostream &messages,
+                            clock::duration interval = std::chrono::seconds(1))
+        : messages_(&messages), interval_(interval),
+          lastReport_(clock::now()) {}
+    RowDiagnostics() = default;
+
+    /// Notes the status of the next row.
+    void record(Status status, Nanoseconds tv, Nanoseconds rangeStart,
+                Nanoseconds rangeEnd) {
+        if (current_.count == 0 || current_.status != status) {
+            endRun();
+            current_.status = status;
+            current_.first = tv;
+        }
+        current_.count++;
+        current_.last = tv;
+        current_.rangeStart = rangeStart;
+        current_.rangeEnd = rangeEnd;
+        if (current_.count % CHECK_EVERY == 0) {
+            checkInterval();
+        }
+    }
+
+    /// Notes runs collected elsewhere, which come next.
+    void add(std::vector<RowRun> const &runs) {
+        for (auto const &run : runs) {
+            if (current_.count == 0 || current_.status != run.status) {
+                endRun();
+                current_ = run;
+            } else {
+                current_.count += run.count;
+                current_.last = run.last;
+                current_.rangeStart = run.rangeStart;
+                current_.rangeEnd = run.rangeEnd;
+            }
+            checkInterval();
+        }
+    }
+
+    /// Ends the current run and, when reporting, reports anything not yet
+    /// reported.
+    void finish() {
+        endRun();
+        if (!messages_) {
+            return;
+        }
+        report();
+        if (extrapolated_.count) {
+            *messages_ << extrapolated_.count
+                       << " reference rows extrapolated past the tracker data, "
+                          "from "
+                       << fromNanoseconds(extrapolated_.first) << " to "
+                       << fromNanoseconds(extrapolated_.last) << std::endl;
+        }
+        for (std::size_t side = 0; side < NUM_SIDES; ++side) {
+            auto const &total = totals_[side];
+            if (total.summaries > 1) {
+                *messages_ << "In all, " << total.count
+                           << " reference rows " << sideName(side)
+                           << " the tracker data, from "
+                           << fromNanoseconds(total.first) << " to "
+                           << fromNanoseconds(total.last) << std::endl;
+            }
+        }
+    }
+
+    /// The runs collected, when not reporting: all of them after finish().
+    std::vector<RowRun> const &runs() const { return runs_; }
+
+  private:
+    /// Rows of a long run recorded between looks at the clock.
+    static const std::uint64_t CHECK_EVERY = 1024;
+
+    /// Which side of the tracker data rows with a status are on, or
+    /// NUM_SIDES if they aren't outside it.
+    static const std::size_t NUM_SIDES = 2;
+    static std::size_t sideOf(Status status) {
+        switch (status) {
+        case Status::BeforeRecordedTrackerData:
+            return 0;
+        case Status::AfterRecordedTrackerData:
+            return 1;
+        default:
+            return NUM_SIDES;
+        }
+    }
+    static const char *sideName(std::size_t side) {
+        return side == 0 ? "before" : "after";
+    }
+
+    /// Rows on one side of the tracker data.
+    struct Tally {
+        std::uint64_t count = 0;
+        Nanoseconds first = 0;
+        Nanoseconds last = 0;
+        Nanoseconds rangeStart = 0;
+        Nanoseconds rangeEnd = 0;
+        /// Summaries these rows were reported in.
+        std::uint64_t summaries = 0;
+
+        void add(RowRun const &run) {
+            if (count == 0) {
+                first = run.first;
+            }
+            count += run.count;
+            last = run.last;
+            rangeStart = run.rangeStart;
+            rangeEnd = run.rangeEnd;
+        }
+    };
+
+    /// Every so often: reports what's pending, cutting a long run of rows
+    /// outside the tracker data short to report it so far.
+    void checkInterval() {
+        if (!messages_ || clock::now() - lastReport_ < interval_) {
+            return;
+        }
+        if (sideOf(current_.status) != NUM_SIDES) {
+            endRun();
+        } else if (hasPending()) {
+            report();
+        }
+    }
+
+    /// Whether a run that just ended can be reported right away: the first
+    /// can, the rest only once it's been an interval since the last.
+    bool due() const {
+        return !reported_ || clock::now() - lastReport_ >= interval_;
+    }
+
+    void endRun() {
+        if (current_.count == 0) {
+            return;
+        }
+        if (!messages_) {
+            runs_.push_back(current_);
+        } else {
+            const auto side = sideOf(current_.status);
+            if (side != NUM_SIDES) {
+                pending_[side].add(current_);
+                totals_[side].add(current_);
+            } else if (current_.status == Status::Extrapolated) {
+                extrapolated_.add(current_);
+            }
+            if (hasPending() && due()) {
+                report();
+            }
+        }
+        current_.count = 0;
+    }
+
+    bool hasPending() const {
+        for (auto const &tally : pending_) {
+            if (tally.count) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void report() {
+        for (std::size_t side = 0; side < NUM_SIDES; ++side) {
+            auto &tally = pending_[side];
+            if (tally.count == 0) {
+                continue;
+            }
+            *messages_ << tally.count << " reference rows " << sideName(side)
+                       << " the tracker data, from "
+                       << fromNanoseconds(tally.first) << " to "
+                       << fromNanoseconds(tally.last) << ", not in [ "
+                       << fromNanoseconds(tally.rangeStart) << " , "
+                       << fromNanoseconds(tally.rangeEnd) << " ]" << std::endl;
+            totals_[side].summaries++;
+            tally = Tally();
+        }
+        reported_ = true;
+        lastReport_ = clock::now();
+    }
+
+    std::ostream *messages_ = nullptr;
+    clock::duration interval_ = clock::duration::zero();
+    RowRun current_;
+    std::vector<RowRun> runs_;
+    Tally pending_[NUM_SIDES];
+    Tally totals_[NUM_SIDES];
+    Tally extrapolated_;
+    bool reported_ = false;
+    clock::time_point lastReport_;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_RowDiagnostics_h_GUID_FF472751_C389_4AF6_BE05_263EDD885564
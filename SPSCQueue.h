@@ -0,0 +1,199 @@
+/** @file
+    @brief Header providing a bounded lock-free single-producer,
+   single-consumer queue for handing work between pipeline threads, and the
+   timing kept for each stage of such a pipeline.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_SPSCQueue_h_GUID_C5995C3C_F77B_4350_A76D_238FAF73CA67
+#define INCLUDED_SPSCQueue_h_GUID_C5995C3C_F77B_4350_A76D_238FAF73CA67
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+// - none
+
+// Standard includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace pipeline {
+
+/// Enough to keep the producer's and consumer's indices off each other's
+/// cache lines.
+static const std::size_t CACHE_LINE_SIZE = 64;
+
+/// Where a pipeline stage's time went: doing its own work, or waiting on the
+/// stage before it (starved) or after it (back-pressure).
+struct StageStats {
+    using clock = std::chrono::steady_clock;
+
+    std::uint64_t batches = 0;
+    clock::duration busy = clock::duration::zero();
+    clock::duration waitingForInput = clock::duration::zero();
+    clock::duration waitingForOutput = clock::duration::zero();
+
+    /// Fraction of the stage's wall time spent doing its own work.
+    double utilization() const {
+        auto total = busy + waitingForInput + waitingForOutput;
+        return total.count() > 0 ? static_cast<double>(busy.count()) /
+                                       static_cast<double>(total.count())
+                                 : 0.;
+    }
+};
+
+/// Bounded ring of T passed from exactly one producer thread to exactly one
+/// consumer thread, without locks. Either side may close it: the producer
+/// once it has nothing more to send, the consumer once it wants no more.
+/// A push waiting on a full ring then gives up, and pops fail once the ring
+/// is empty.
+template <typename T> class SPSCQueue {
+  public:
+    /// The capacity is rounded up to a power of two.
+    explicit SPSCQueue(std::size_t capacity) {
+        std::size_t n = 1;
+        while (n < capacity) {
+            n *= 2;
+        }
+        ring_.resize(n);
+        mask_ = n - 1;
+    }
+    SPSCQueue(SPSCQueue const &) = delete;
+    SPSCQueue &operator=(SPSCQueue const &) = delete;
+
+    std::size_t capacity() const { return ring_.size(); }
+
+    /// Producer only: false if the ring is full.
+    bool tryPush(T const &item) {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ == ring_.size()) {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ == ring_.size()) {
+                return false;
+            }
+        }
+        ring_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer only: false if the ring is empty.
+    bool tryPop(T &item) {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_) {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_) {
+                return false;
+            }
+        }
+        item = ring_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Producer only: waits while the ring is full, adding the time spent to
+    /// waited. False if the queue was closed instead.
+    bool push(T const &item, StageStats::clock::duration &waited) {
+        if (tryPush(item)) {
+            return true;
+        }
+        const auto begin = StageStats::clock::now();
+        bool pushed = false;
+        for (unsigned spins = 0; !closed(); ++spins) {
+            if (tryPush(item)) {
+                pushed = true;
+                break;
+            }
+            backOff(spins);
+        }
+        waited += StageStats::clock::now() - begin;
+        return pushed;
+    }
+
+    /// Consumer only: waits while the ring is empty, adding the time spent to
+    /// waited. False once the queue is closed and drained.
+    bool pop(T &item, StageStats::clock::duration &waited) {
+        if (tryPop(item)) {
+            return true;
+        }
+        const auto begin = StageStats::clock::now();
+        bool popped = false;
+        for (unsigned spins = 0;; ++spins) {
+            /// Check for closing before the last try, so nothing pushed just
+            /// before the close is missed.
+            const bool wasClosed = closed();
+            if (tryPop(item)) {
+                popped = true;
+                break;
+            }
+            if (wasClosed) {
+                break;
+            }
+            backOff(spins);
+        }
+        waited += StageStats::clock::now() - begin;
+        return popped;
+    }
+
+    void close() { closed_.store(true, std::memory_order_release); }
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  private:
+    /// Spin briefly in case the other side is just about done, then give up
+    /// the core.
+    static void backOff(unsigned spins) {
+        if (spins >= 64) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::vector<T> ring_;
+    std::size_t mask_;
+    std::atomic<bool> closed_{false};
+
+    /// @name Consumer side
+    /// @{
+    /// Next slot to pop.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> head_{0};
+    /// Last look at tail_, so the producer's line is only read when the ring
+    /// seems empty.
+    std::size_t tailCache_ = 0;
+    /// @}
+
+    /// @name Producer side
+    /// @{
+    /// Next slot to push.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> tail_{0};
+    /// Last look at head_, so the consumer's line is only read when the ring
+    /// seems full.
+    std::size_t headCache_ = 0;
+    /// @}
+};
+
+} // namespace pipeline
+
+#endif // INCLUDED_SPSCQueue_h_GUID_C5995C3C_F77B_4350_A76D_238FAF73CA67
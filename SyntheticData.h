@@ -0,0 +1,190 @@
+/** @file
+    @brief Header providing a deterministic generator of tracker and time
+   reference CSV data, for benchmarks.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_SyntheticData_h_GUID_15121796_1B5E_4E22_86E4_E8E0499C38DE
+#define INCLUDED_SyntheticData_h_GUID_15121796_1B5E_4E22_86E4_E8E0499C38DE
+
+// Internal Includes
+#include "NumericFormatting.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace motionsynth {
+namespace synthetic {
+
+    /// What to generate. The same parameters always give the same bytes.
+    struct Params {
+        /// Tracker samples per second.
+        double trackerRate = 1000.;
+        /// Reference rows per second.
+        double referenceRate = 90.;
+        /// Seconds of tracker data. The reference rows start a little before
+        /// and end a little after, so both ends of the range get exercised.
+        double duration = 60.;
+        /// How fast the tracked object turns, in degrees per second.
+        double angularVelocity = 90.;
+        /// Most a timestamp may be off from its nominal time, in
+        /// microseconds. Capped below half the sample spacing, so the
+        /// timestamps still always increase.
+        double jitter = 0.;
+        std::uint32_t seed = 1;
+        /// Time of the first tracker sample, in microseconds.
+        std::int64_t startUsec = 1458000000LL * 1000000LL;
+    };
+
+    /// Uniform numbers from the raw output of mt19937, which the standard
+    /// pins down exactly, unlike its distributions.
+    class Random {
+      public:
+        explicit Random(std::uint32_t seed) : gen_(seed) {}
+        /// In [-1, 1].
+        double symmetric() {
+            return 2. * static_cast<double>(gen_()) /
+                       static_cast<double>(std::mt19937::max()) -
+                   1.;
+        }
+
+      private:
+        std::mt19937 gen_;
+    };
+
+    /// Decimals written for positions and for rotation components, about
+    /// what recorded tracker logs carry.
+    static const int POSITION_DECIMALS = 6;
+    static const int ROTATION_DECIMALS = 9;
+
+    namespace detail {
+        inline void appendNumber(std::string &out, double val, int decimals) {
+            char buf[numformat::MAX_FORMATTED_LENGTH];
+            out.append(buf, numformat::formatFixed(buf, val, decimals));
+        }
+        inline void appendNumber(std::string &out, std::int64_t val) {
+            out += std::to_string(val);
+        }
+        inline void appendTimestamp(std::string &out, std::int64_t usec) {
+            appendNumber(out, usec / 1000000);
+            out += ',';
+            appendNumber(out, usec % 1000000);
+        }
+        /// Timestamps at the given rate from begin to end, with jitter.
+        template <typename F>
+        inline void forEachTimestamp(std::int64_t beginUsec,
+                                     std::int64_t endUsec, double rate,
+                                     double jitter, Random &random, F fn) {
+            const double period = 1e6 / rate;
+            jitter = std::min(jitter, 0.45 * period);
+            for (std::int64_t i = 0;; ++i) {
+                const double nominal = static_cast<double>(i) * period;
+                const auto usec =
+                    beginUsec + static_cast<std::int64_t>(std::llround(
+                                    nominal + jitter * random.symmetric()));
+                if (usec > endUsec) {
+                    return;
+                }
+                fn(i, usec);
+            }
+        }
+    } // namespace detail
+
+    /// Pose of the tracked object t seconds in: turning steadily about a
+    /// tilted axis while moving around a circle.
+    inline void pose(Params const &params, double t, Eigen::Vector3d &xlate,
+                     Eigen::Quaterniond &rot) {
+        const double angle = params.angularVelocity * EIGEN_PI / 180. * t;
+        rot = Eigen::Quaterniond(Eigen::AngleAxisd(
+            angle, Eigen::Vector3d(0.3, 1., 0.2).normalized()));
+        xlate = Eigen::Vector3d(0.5 * std::cos(0.5 * t),
+                                1.5 + 0.1 * std::sin(t),
+                                0.5 * std::sin(0.5 * t));
+    }
+
+    /// Tracker CSV: header, then sec,usec,x,y,z,qw,qx,qy,qz rows.
+    inline std::string trackerCSV(Params const &params) {
+        std::string out = "\"sec\",\"usec\",\"x\",\"y\",\"z\",\"qw\",\"qx\","
+                          "\"qy\",\"qz\"\n";
+        Random random(params.seed);
+        const auto endUsec =
+            params.startUsec +
+            static_cast<std::int64_t>(std::llround(params.duration * 1e6));
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+        detail::forEachTimestamp(
+            params.startUsec, endUsec, params.trackerRate, params.jitter,
+            random, [&](std::int64_t, std::int64_t usec) {
+                const auto t =
+                    static_cast<double>(usec - params.startUsec) / 1e6;
+                pose(params, t, xlate, rot);
+                detail::appendTimestamp(out, usec);
+                for (double val : {xlate.x(), xlate.y(), xlate.z()}) {
+                    out += ',';
+                    detail::appendNumber(out, val, POSITION_DECIMALS);
+                }
+                for (double val : {rot.w(), rot.x(), rot.y(), rot.z()}) {
+                    out += ',';
+                    detail::appendNumber(out, val, ROTATION_DECIMALS);
+                }
+                out += '\n';
+            });
+        return out;
+    }
+
+    /// Time reference CSV: header, then sec,usec,frame,value rows, running
+    /// from a little before the tracker data to a little after.
+    inline std::string referenceCSV(Params const &params) {
+        std::string out = "\"sec\",\"usec\",\"frame\",\"value\"\n";
+        Random random(params.seed ^ 0x9e3779b9u);
+        const double period = 1e6 / params.referenceRate;
+        const auto margin = static_cast<std::int64_t>(std::llround(period));
+        const auto endUsec =
+            params.startUsec +
+            static_cast<std::int64_t>(std::llround(params.duration * 1e6));
+        detail::forEachTimestamp(
+            params.startUsec - margin, endUsec + margin, params.referenceRate,
+            params.jitter, random, [&](std::int64_t i, std::int64_t usec) {
+                detail::appendTimestamp(out, usec);
+                out += ',';
+                detail::appendNumber(out, i);
+                out += ',';
+                detail::appendNumber(out, random.symmetric(),
+                                     POSITION_DECIMALS);
+                out += '\n';
+            });
+        return out;
+    }
+
+} // namespace synthetic
+} // namespace motionsynth
+
+#endif // INCLUDED_SyntheticData_h_GUID_15121796_1B5E_4E22_86E4_E8E0499C38DE
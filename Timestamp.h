@@ -0,0 +1,114 @@
+/** @file
+    @brief Header providing the tool's own time base: a single count of
+   nanoseconds, with conversions that are all inline and constexpr, and
+   optional interop with OSVR's TimeValue.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_Timestamp_h_GUID_929E3746_3BF1_43B2_9B2E_9CF5E6C7EDB2
+#define INCLUDED_Timestamp_h_GUID_929E3746_3BF1_43B2_9B2E_9CF5E6C7EDB2
+
+// Internal Includes
+// - none
+
+// Library/third-party includes
+#ifdef MOTION_SYNTHESIZER_OSVR_INTEROP
+#include <osvr/Util/TimeValue.h>
+#endif
+
+// Standard includes
+#include <cstdint>
+#include <ostream>
+
+namespace motionsynth {
+
+/// Time on the internal timeline: a single count of nanoseconds. Intervals
+/// are plain integer differences, good for centuries, and tracker stamps
+/// finer than a microsecond fit. Being a built-in type, comparisons and
+/// arithmetic on it are as cheap as they get.
+using Nanoseconds = std::int64_t;
+static const Nanoseconds NANOSECONDS_PER_MICROSECOND = 1000;
+static const Nanoseconds NANOSECONDS_PER_SECOND = 1000000000;
+static const std::int64_t MICROSECONDS_PER_SECOND = 1000000;
+
+namespace detail {
+    /// Division rounding towards negative infinity.
+    constexpr std::int64_t floorDivide(std::int64_t a, std::int64_t b) {
+        return a / b - (a % b < 0 ? 1 : 0);
+    }
+    /// What's left over from floorDivide: never negative.
+    constexpr std::int64_t floorRemainder(std::int64_t a, std::int64_t b) {
+        return a % b < 0 ? a % b + b : a % b;
+    }
+} // namespace detail
+
+constexpr Nanoseconds fromMicroseconds(std::int64_t usec) {
+    return usec * NANOSECONDS_PER_MICROSECOND;
+}
+
+/// Rounded down to the microsecond.
+constexpr std::int64_t toMicroseconds(Nanoseconds t) {
+    return detail::floorDivide(t, NANOSECONDS_PER_MICROSECOND);
+}
+
+/// A time split the way the input files and messages write it.
+struct SecondsAndMicroseconds {
+    std::int64_t seconds;
+    /// Always in [0, 1000000).
+    std::int32_t microseconds;
+};
+
+/// Rounded down to the microsecond, for messages.
+constexpr SecondsAndMicroseconds fromNanoseconds(Nanoseconds t) {
+    return SecondsAndMicroseconds{
+        detail::floorDivide(toMicroseconds(t), MICROSECONDS_PER_SECOND),
+        static_cast<std::int32_t>(detail::floorRemainder(
+            toMicroseconds(t), MICROSECONDS_PER_SECOND))};
+}
+
+inline std::ostream &operator<<(std::ostream &os,
+                                SecondsAndMicroseconds const &tv) {
+    os << tv.seconds << ":" << tv.microseconds;
+    return os;
+}
+
+#ifdef MOTION_SYNTHESIZER_OSVR_INTEROP
+/// For embedding alongside the OSVR SDK: its TimeValue to and from the
+/// internal timeline. The tool itself never needs these.
+inline Nanoseconds toNanoseconds(osvr::util::time::TimeValue const &tv) {
+    return static_cast<Nanoseconds>(tv.seconds) * NANOSECONDS_PER_SECOND +
+           fromMicroseconds(tv.microseconds);
+}
+
+/// Rounded down to the microsecond.
+inline osvr::util::time::TimeValue toTimeValue(Nanoseconds t) {
+    const auto split = fromNanoseconds(t);
+    osvr::util::time::TimeValue tv;
+    tv.seconds = split.seconds;
+    tv.microseconds = split.microseconds;
+    return tv;
+}
+#endif // MOTION_SYNTHESIZER_OSVR_INTEROP
+
+} // namespace motionsynth
+
+#endif // INCLUDED_Timestamp_h_GUID_929E3746_3BF1_43B2_9B2E_9CF5E6C7EDB2
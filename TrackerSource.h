@@ -0,0 +1,247 @@
+/** @file
+    @brief Header providing the interface for reading timestamped tracker
+   poses in order, and its implementation for CSV tracker data.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_TrackerSource_h_GUID_C41F7E2B_0A6D_4E93_B85C_2D97F0A3E61B
+#define INCLUDED_TrackerSource_h_GUID_C41F7E2B_0A6D_4E93_B85C_2D97F0A3E61B
+
+// Internal Includes
+#include "CSVTools.h"
+#include "Instrumentation.h"
+#include "LineSource.h"
+#include "NumericParsing.h"
+#include "Timestamp.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace motionsynth {
+
+/// Parses the sec,usec fields found at the start of a row. The usec field
+/// may have up to three decimals, for stamps finer than a microsecond.
+inline bool parseTimestampFields(csvtools::StringRef line,
+                                 csvtools::FieldSpans const &spans,
+                                 Nanoseconds &t) {
+    auto sec = spans.view(line, 0);
+    auto usec = spans.view(line, 1);
+    std::int64_t seconds = 0;
+    Nanoseconds fraction = 0;
+    if (!numparse::parse(sec.begin(), sec.end(), seconds) ||
+        !numparse::parseScaled(usec.begin(), usec.end(), 3, fraction)) {
+        return false;
+    }
+    t = seconds * NANOSECONDS_PER_SECOND + fraction;
+    return true;
+}
+
+/// Parses the sec,usec fields that start both tracker and reference rows,
+/// returning false if the line doesn't start with two numbers.
+inline bool parseTimestamp(csvtools::StringRef line,
+                           csvtools::FieldSpans &spans, Nanoseconds &t) {
+    if (csvtools::getFieldSpans(line, 2, spans) != 2) {
+        return false;
+    }
+    return parseTimestampFields(line, spans, t);
+}
+
+/// Interface for a sequence of timestamped tracker poses, in recorded order.
+class TrackerSource {
+  public:
+    virtual ~TrackerSource() = default;
+
+    /// The samples whose timestamps were read most recently.
+    enum class Recent { Last, BeforeLast };
+
+    /// Reads just the timestamp of the next sample, returning false once out
+    /// of data. Its pose is only decoded if asked for, with decodePose, so
+    /// passing over samples is cheap.
+    virtual bool readTimestamp(Nanoseconds &t) = 0;
+    /// Decodes the pose of one of the last two samples read since the start
+    /// or the last seek, returning false if there weren't that many or its
+    /// pose isn't all numbers.
+    virtual bool decodePose(Recent which, Eigen::Vector3d &xlate,
+                            Eigen::Quaterniond &rot) = 0;
+
+    /// Whether the next sample, or the end of the data, can be read without
+    /// waiting for more to come in. Only live sources ever have to wait.
+    virtual bool sampleReady() { return true; }
+
+    /// Reads the next pose, returning false once out of data.
+    bool readPose(Nanoseconds &t, Eigen::Vector3d &xlate,
+                  Eigen::Quaterniond &rot) {
+        return readTimestamp(t) && decodePose(Recent::Last, xlate, rot);
+    }
+
+    /// Moves to the start of the interval containing t: the next pose read
+    /// is the last one at or before t (the first if t is before them all),
+    /// but never the very last one, so there's always an interval to read.
+    /// Returns false if this source can't seek.
+    virtual bool seek(Nanoseconds /*t*/) { return false; }
+};
+
+/// Poses parsed from CSV rows of sec,usec,x,y,z,qw,qx,qy,qz. The header line
+/// must already have been consumed.
+class CSVTrackerSource : public TrackerSource {
+  public:
+    static const std::size_t FIELDS_IN_TRACKER_DATA = 9;
+
+    explicit CSVTrackerSource(csvtools::LineSource &lines) : lines_(lines) {}
+
+    /// Every row is still split into all its fields, so a short one ends
+    /// the data whether or not its pose gets decoded, as does one whose
+    /// timestamp isn't a number.
+    bool readTimestamp(Nanoseconds &t) override {
+        auto &row = rows_[last_ ^ 1];
+        bool parsed = false;
+        if (lines_.getRow(row.line, row.spans, FIELDS_IN_TRACKER_DATA) &&
+            row.spans.size() == FIELDS_IN_TRACKER_DATA) {
+            MOTIONSYNTH_INSTRUMENT_SCOPE(NumericParsing);
+            parsed = parseTimestampFields(row.line, row.spans, t);
+        }
+        if (!parsed) {
+            /// That was where the one before the last was.
+            recent_ = std::min(recent_, 1);
+            return false;
+        }
+        if (!lines_.linesPersist()) {
+            row.text.assign(row.line.begin(), row.line.end());
+            row.line = csvtools::StringRef(row.text);
+        }
+        last_ ^= 1;
+        recent_ = std::min(recent_ + 1, 2);
+        return true;
+    }
+
+    bool decodePose(Recent which, Eigen::Vector3d &xlate,
+                    Eigen::Quaterniond &rot) override {
+        const bool last = which == Recent::Last;
+        if (recent_ < (last ? 1 : 2)) {
+            return false;
+        }
+        auto const &row = rows_[last ? last_ : last_ ^ 1];
+        MOTIONSYNTH_INSTRUMENT_SCOPE(NumericParsing);
+        return getField(row, TX, xlate.x()) && getField(row, TY, xlate.y()) &&
+               getField(row, TZ, xlate.z()) && getField(row, QX, rot.x()) &&
+               getField(row, QY, rot.y()) && getField(row, QZ, rot.z()) &&
+               getField(row, QW, rot.w());
+    }
+
+    bool sampleReady() override { return lines_.lineReady(); }
+
+    /// Forgets the rows read so far, for when the line source has been moved.
+    void forgetRecent() { recent_ = 0; }
+
+  private:
+    enum {
+        TX = 2,
+        TY = 3,
+        TZ = 4,
+        QW = 5,
+        QX = 6,
+        QY = 7,
+        QZ = 8
+    };
+
+    /// A row read, kept until the pose might be wanted.
+    struct Row {
+        csvtools::StringRef line;
+        csvtools::FieldSpans spans;
+        /// Copy of the line, if the line source reuses its buffer.
+        std::string text;
+    };
+
+    template <typename T>
+    static bool getField(Row const &row, std::size_t field, T &output) {
+        auto view = row.spans.view(row.line, field);
+        return numparse::parse(view.begin(), view.end(), output);
+    }
+
+    csvtools::LineSource &lines_;
+
+    /// @name Row parsing state, reused from row to row
+    /// @{
+    /// The last two rows read: the last at last_, the one before the other.
+    Row rows_[2];
+    int last_ = 0;
+    /// How many of them there are.
+    int recent_ = 0;
+    /// @}
+};
+
+/// CSV tracker data in a mapped file, which can seek by binary search on the
+/// rows' timestamps.
+class MappedCSVTrackerSource : public TrackerSource {
+  public:
+    /// Reads rows starting at bodyBegin, which is just past the header line.
+    MappedCSVTrackerSource(const char *data, std::size_t size,
+                           std::size_t bodyBegin)
+        : lines_(data, size), rows_(lines_), bodyBegin_(bodyBegin) {
+        lines_.seek(bodyBegin_);
+    }
+
+    bool readTimestamp(Nanoseconds &t) override {
+        return rows_.readTimestamp(t);
+    }
+    bool decodePose(Recent which, Eigen::Vector3d &xlate,
+                    Eigen::Quaterniond &rot) override {
+        return rows_.decodePose(which, xlate, rot);
+    }
+
+    bool seek(Nanoseconds t) override {
+        const auto data = lines_.data();
+        const auto size = lines_.size();
+        auto pos = csvtools::findLastLineNotAfter(
+            data, bodyBegin_, size, t,
+            [&](csvtools::StringRef line, Nanoseconds &key) {
+                return parseTimestamp(line, probeSpans_, key);
+            });
+        /// Back up one row if that was the last.
+        auto next = csvtools::lineStartAtOrAfter(data, size, pos + 1);
+        if (next >= size ||
+            csvtools::trimLineEnding(csvtools::StringRef(data + next, 1))
+                .empty()) {
+            pos = csvtools::previousLineStart(data, bodyBegin_, pos);
+        }
+        lines_.seek(pos);
+        rows_.forgetRecent();
+        return true;
+    }
+
+  private:
+    csvtools::MappedLineSource lines_;
+    CSVTrackerSource rows_;
+    std::size_t bodyBegin_;
+    csvtools::FieldSpans probeSpans_;
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_TrackerSource_h_GUID_C41F7E2B_0A6D_4E93_B85C_2D97F0A3E61B
@@ -0,0 +1,211 @@
+/** @file
+    @brief Header providing an in-memory columnar store of all tracker
+   samples, for engines that need random access to them.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef INCLUDED_TrackerStore_h_GUID_2E8C5A91_D374_4B0F_A6E2_91F7C3D08B54
+#define INCLUDED_TrackerStore_h_GUID_2E8C5A91_D374_4B0F_A6E2_91F7C3D08B54
+
+// Internal Includes
+#include "LineSource.h"
+#include "ParallelFor.h"
+#include "TrackerSource.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace motionsynth {
+
+/// All tracker samples, one array per column like the binary tracker format:
+/// timestamps (in nanoseconds here), then position and rotation components.
+class TrackerStore {
+  public:
+    std::size_t size() const { return t_.size(); }
+    bool empty() const { return t_.empty(); }
+
+    void reserve(std::size_t n) {
+        t_.reserve(n);
+        for (auto &col : cols_) {
+            col.reserve(n);
+        }
+    }
+
+    void append(Nanoseconds t, Eigen::Vector3d const &xlate,
+                Eigen::Quaterniond const &rot) {
+        t_.push_back(t);
+        cols_[X].push_back(xlate.x());
+        cols_[Y].push_back(xlate.y());
+        cols_[Z].push_back(xlate.z());
+        cols_[QW].push_back(rot.w());
+        cols_[QX].push_back(rot.x());
+        cols_[QY].push_back(rot.y());
+        cols_[QZ].push_back(rot.z());
+    }
+
+    /// Appends everything left in the source, returning how many samples
+    /// that was.
+    std::size_t loadFrom(TrackerSource &source) {
+        Nanoseconds t = 0;
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+        std::size_t n = 0;
+        while (source.readPose(t, xlate, rot)) {
+            append(t, xlate, rot);
+            ++n;
+        }
+        return n;
+    }
+
+    /// Replaces the contents with the CSV tracker rows in [begin, end) of
+    /// data, which must start at a line after the header. The rows are split
+    /// into chunks at line boundaries and parsed on up to the given number of
+    /// threads (0: one per core), each straight into its own part of the
+    /// preallocated columns. As with loadFrom, loading stops at the first
+    /// row that isn't a sample. Throws if the timestamps of the rows loaded
+    /// go backwards. Returns the number of samples.
+    std::size_t loadCSV(const char *data, std::size_t begin, std::size_t end,
+                        std::size_t threads = 0) {
+        if (threads == 0) {
+            threads = parallel::defaultThreads();
+        }
+        const auto chunks = csvtools::chunkCount(end - begin, threads);
+        const auto bounds = csvtools::splitAtLines(data, begin, end, chunks);
+
+        /// Count the lines to find where each chunk's samples go...
+        std::vector<std::size_t> firstRow(chunks + 1, 0);
+        parallel::forEachIndex(chunks, threads, [&](std::size_t i) {
+            auto b = data + bounds[i];
+            auto e = data + bounds[i + 1];
+            auto lines = static_cast<std::size_t>(std::count(b, e, '\n'));
+            if (b != e && e[-1] != '\n') {
+                // last line with no line ending
+                lines++;
+            }
+            firstRow[i + 1] = lines;
+        });
+        for (std::size_t i = 0; i < chunks; ++i) {
+            firstRow[i + 1] += firstRow[i];
+        }
+        resize(firstRow[chunks]);
+
+        /// ...then parse them there, noting how many of each were samples
+        /// and the first, if any, to go back in time.
+        static const std::size_t IN_ORDER = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> parsed(chunks, 0);
+        std::vector<std::size_t> backwardsAt(chunks, IN_ORDER);
+        parallel::forEachIndex(chunks, threads, [&](std::size_t i) {
+            csvtools::MappedLineSource lines(data + bounds[i],
+                                             bounds[i + 1] - bounds[i]);
+            CSVTrackerSource source(lines);
+            Nanoseconds t = 0;
+            Eigen::Vector3d xlate;
+            Eigen::Quaterniond rot;
+            auto row = firstRow[i];
+            while (row < firstRow[i + 1] && source.readPose(t, xlate, rot)) {
+                set(row, t, xlate, rot);
+                if (row > firstRow[i] && t_[row] < t_[row - 1] &&
+                    backwardsAt[i] == IN_ORDER) {
+                    backwardsAt[i] = row;
+                }
+                ++row;
+            }
+            parsed[i] = row - firstRow[i];
+        });
+
+        /// Keep everything up to the first row that wasn't a sample...
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < chunks; ++i) {
+            n = firstRow[i] + parsed[i];
+            if (n < firstRow[i + 1]) {
+                break;
+            }
+        }
+        /// ...which has to be in order, within chunks and across them. The
+        /// rows after it don't matter, as they wouldn't to loadFrom.
+        for (std::size_t i = 0; i < chunks && firstRow[i] < n; ++i) {
+            if (backwardsAt[i] < n ||
+                (i > 0 && t_[firstRow[i]] < t_[firstRow[i] - 1])) {
+                throw std::runtime_error("Tracker data timestamps must not "
+                                         "go backwards!");
+            }
+        }
+        resize(n);
+        return n;
+    }
+
+    /// True if no timestamp is less than the one before it, as needed to
+    /// search them.
+    bool isSorted() const {
+        for (std::size_t i = 1; i < t_.size(); ++i) {
+            if (t_[i] < t_[i - 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<Nanoseconds> const &timestamps() const { return t_; }
+    Nanoseconds timestamp(std::size_t i) const { return t_[i]; }
+    Eigen::Vector3d xlate(std::size_t i) const {
+        return Eigen::Vector3d(cols_[X][i], cols_[Y][i], cols_[Z][i]);
+    }
+    Eigen::Quaterniond rot(std::size_t i) const {
+        return Eigen::Quaterniond(cols_[QW][i], cols_[QX][i], cols_[QY][i],
+                                  cols_[QZ][i]);
+    }
+
+  private:
+    void resize(std::size_t n) {
+        t_.resize(n);
+        for (auto &col : cols_) {
+            col.resize(n);
+        }
+    }
+    void set(std::size_t i, Nanoseconds t, Eigen::Vector3d const &xlate,
+             Eigen::Quaterniond const &rot) {
+        t_[i] = t;
+        cols_[X][i] = xlate.x();
+        cols_[Y][i] = xlate.y();
+        cols_[Z][i] = xlate.z();
+        cols_[QW][i] = rot.w();
+        cols_[QX][i] = rot.x();
+        cols_[QY][i] = rot.y();
+        cols_[QZ][i] = rot.z();
+    }
+
+    enum Column { X, Y, Z, QW, QX, QY, QZ, NUM_COLUMNS };
+    std::vector<Nanoseconds> t_;
+    std::vector<double> cols_[NUM_COLUMNS];
+};
+
+} // namespace motionsynth
+
+#endif // INCLUDED_TrackerStore_h_GUID_2E8C5A91_D374_4B0F_A6E2_91F7C3D08B54
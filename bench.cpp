@@ -0,0 +1,561 @@
+/** @file
+    @brief Implementation of the benchmark suite: times the CSV, tracker
+   reading and interpolation hot paths on generated data, and reports the
+   results as JSON.
+
+    @date 2016
+
+    @author
+    Sensics, Inc.
+    <http://sensics.com/osvr>
+*/
+
+// Copyright 2016 Sensics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal Includes
+#include "BufferedWriter.h"
+#include "CSVTools.h"
+#include "LineSource.h"
+#include "LivePoseBuffer.h"
+#include "MotionSynthesizer.h"
+#include "NumericParsing.h"
+#include "ReferenceRows.h"
+#include "SyntheticData.h"
+#include "TrackerSource.h"
+#include "TrackerStore.h"
+
+// Library/third-party includes
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Standard includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using motionsynth::CSVTrackerSource;
+using motionsynth::MotionSynthesizer;
+using motionsynth::ReferenceBatch;
+using motionsynth::Status;
+using motionsynth::Nanoseconds;
+using motionsynth::TrackerSource;
+using motionsynth::TrackerStore;
+namespace synthetic = motionsynth::synthetic;
+
+#ifdef _WIN32
+static const char NULL_DEVICE[] = "NUL";
+#else
+static const char NULL_DEVICE[] = "/dev/null";
+#endif
+
+void usage() {
+    std::cerr
+        << "Times the hot paths of motion-synthesizer on generated data and "
+           "writes the results\n"
+           "as JSON to standard output.\n"
+           "Options:\n"
+           "  --tracker-rate <Hz>        Tracker samples per second (default "
+           "1000).\n"
+           "  --reference-rate <Hz>      Reference rows per second (default "
+           "90).\n"
+           "  --duration <s>             Seconds of data (default 60).\n"
+           "  --angular-velocity <deg/s> How fast the tracker turns (default "
+           "90).\n"
+           "  --jitter <usec>            Timestamp jitter (default 0).\n"
+           "  --seed <n>                 Random seed (default 1).\n"
+           "  --min-time <s>             Run each benchmark at least this "
+           "long (default 1).\n"
+           "  --json <file>              Write the results here instead.\n"
+           "  --write-data <tracker CSV> <reference CSV>\n"
+           "                             Just write the generated data to "
+           "these files.\n"
+           "  --stress-live-buffer       Just check the live pose buffer: "
+           "query it from 3\n"
+           "                             threads while another pushes the "
+           "samples, and fail\n"
+           "                             on any wrong or torn pose. Worth "
+           "running under TSan."
+        << std::endl;
+}
+
+struct Options {
+    synthetic::Params params;
+    double minTime = 1.;
+    std::string jsonFn;
+    std::string trackerOutFn;
+    std::string referenceOutFn;
+    bool stressLiveBuffer = false;
+};
+
+/// Returns false if the command line couldn't be understood.
+bool parseOptions(int argc, char *argv[], Options &opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto number = [&](double &out) {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a value" << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            if (!numparse::parse(val.data(), val.data() + val.size(), out) ||
+                !(out >= 0)) {
+                std::cerr << "Bad value for " << arg << ": " << val
+                          << std::endl;
+                return false;
+            }
+            return true;
+        };
+        auto &params = opts.params;
+        double seed = 0;
+        bool ok = true;
+        if (arg == "--tracker-rate") {
+            ok = number(params.trackerRate) && params.trackerRate > 0;
+        } else if (arg == "--reference-rate") {
+            ok = number(params.referenceRate) && params.referenceRate > 0;
+        } else if (arg == "--duration") {
+            ok = number(params.duration);
+        } else if (arg == "--angular-velocity") {
+            ok = number(params.angularVelocity);
+        } else if (arg == "--jitter") {
+            ok = number(params.jitter);
+        } else if (arg == "--seed") {
+            ok = number(seed);
+            params.seed = static_cast<std::uint32_t>(seed);
+        } else if (arg == "--min-time") {
+            ok = number(opts.minTime);
+        } else if (arg == "--json" && i + 1 < argc) {
+            opts.jsonFn = argv[++i];
+        } else if (arg == "--write-data" && i + 2 < argc) {
+            opts.trackerOutFn = argv[++i];
+            opts.referenceOutFn = argv[++i];
+        } else if (arg == "--stress-live-buffer") {
+            opts.stressLiveBuffer = true;
+        } else {
+            std::cerr << "Unrecognized option " << arg << std::endl;
+            return false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// How much one pass of a benchmark got through.
+struct Work {
+    std::uint64_t items;
+    std::uint64_t bytes;
+};
+
+struct Result {
+    std::string name;
+    std::uint64_t iterations = 0;
+    std::uint64_t items = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+/// Something for the benchmarks to fold their results into, so they can't
+/// be optimized away.
+static volatile std::uint64_t g_sink;
+
+/// Repeats full passes of fn until at least minTime seconds have gone by.
+template <typename F> Result run(const char *name, double minTime, F fn) {
+    using clock = std::chrono::steady_clock;
+    Result ret;
+    ret.name = name;
+    const auto begin = clock::now();
+    do {
+        Work work = fn();
+        ret.iterations++;
+        ret.items += work.items;
+        ret.bytes += work.bytes;
+        ret.seconds =
+            std::chrono::duration<double>(clock::now() - begin).count();
+    } while (ret.seconds < minTime);
+    std::cerr << name << ": " << ret.seconds * 1e9 / ret.items
+              << " ns per item, " << ret.bytes / ret.seconds / 1e6
+              << " MB/s" << std::endl;
+    return ret;
+}
+
+/// Replays tracker samples already in memory, so interpolation can be timed
+/// without the parsing.
+class StoreTrackerSource : public TrackerSource {
+  public:
+    explicit StoreTrackerSource(TrackerStore const &store) : store_(store) {}
+    bool readTimestamp(Nanoseconds &tv) override {
+        if (i_ >= store_.size()) {
+            return false;
+        }
+        tv = store_.timestamp(i_);
+        ++i_;
+        return true;
+    }
+    bool decodePose(Recent which, Eigen::Vector3d &xlate,
+                    Eigen::Quaterniond &rot) override {
+        const std::size_t back = which == Recent::Last ? 1 : 2;
+        if (i_ < back) {
+            return false;
+        }
+        xlate = store_.xlate(i_ - back);
+        rot = store_.rot(i_ - back);
+        return true;
+    }
+
+  private:
+    TrackerStore const &store_;
+    std::size_t i_ = 0;
+};
+
+/// Lines of a CSV buffer, without the header.
+std::vector<csvtools::StringRef> dataLines(std::string const &csv) {
+    std::vector<csvtools::StringRef> ret;
+    csvtools::MappedLineSource lines(csv.data(), csv.size());
+    csvtools::StringRef line;
+    lines.getLine(line);
+    while (lines.getLine(line)) {
+        ret.push_back(line);
+    }
+    return ret;
+}
+
+void writeJSON(std::ostream &os, synthetic::Params const &params,
+               std::vector<Result> const &results) {
+    os << "{\n  \"params\": {\"trackerRate\": " << params.trackerRate
+       << ", \"referenceRate\": " << params.referenceRate
+       << ", \"duration\": " << params.duration
+       << ", \"angularVelocity\": " << params.angularVelocity
+       << ", \"jitter\": " << params.jitter << ", \"seed\": " << params.seed
+       << "},\n  \"results\": [";
+    bool first = true;
+    for (auto const &r : results) {
+        os << (first ? "\n" : ",\n") << "    {\"name\": \"" << r.name
+           << "\", \"iterations\": " << r.iterations
+           << ", \"items\": " << r.items << ", \"bytes\": " << r.bytes
+           << ", \"seconds\": " << r.seconds
+           << ", \"nsPerItem\": " << r.seconds * 1e9 / r.items
+           << ", \"itemsPerSecond\": " << r.items / r.seconds
+           << ", \"bytesPerSecond\": " << r.bytes / r.seconds << "}";
+        first = false;
+    }
+    os << "\n  ]\n}" << std::endl;
+}
+
+/// Motion that interpolation and extrapolation both reproduce exactly:
+/// moving in a straight line while turning steadily about a tilted axis.
+void linearPose(synthetic::Params const &params, double t,
+                Eigen::Vector3d &xlate, Eigen::Quaterniond &rot) {
+    const double angle = params.angularVelocity * EIGEN_PI / 180. * t;
+    rot = Eigen::Quaterniond(Eigen::AngleAxisd(
+        angle, Eigen::Vector3d(0.3, 1., 0.2).normalized()));
+    xlate = Eigen::Vector3d(0.5 * t, -1. * t, 0.25 * t);
+}
+
+/// Pushes the tracker samples into a LivePoseBuffer as fast as it takes
+/// them, while several threads query it around its newest sample and check
+/// each pose against the motion it was sampled from. A torn read, or a
+/// query answered from the wrong samples, shows up as a wrong pose.
+/// Returns false if there was one, or if no query got a pose at all.
+bool stressLiveBuffer(synthetic::Params const &params) {
+    static const unsigned READERS = 3;
+    static const std::size_t CAPACITY = 64;
+    /// Most a pose may be off, in meters or radians.
+    static const double TOLERANCE = 1e-9;
+    static const std::size_t STATUSES =
+        static_cast<std::size_t>(Status::OtherUnexpectedFailure) + 1;
+
+    const auto period = static_cast<Nanoseconds>(1e9 / params.trackerRate);
+    const auto samples =
+        static_cast<std::uint64_t>(params.duration * params.trackerRate) + 1;
+    motionsynth::ExtrapolationPolicy extrapolation;
+    extrapolation.maxHorizon = 5 * period;
+    extrapolation.window = 3;
+    motionsynth::LivePoseBuffer buffer(
+        CAPACITY, motionsynth::RotationPolicy(), extrapolation);
+    const auto start = motionsynth::fromMicroseconds(params.startUsec);
+    auto seconds = [&](Nanoseconds t) {
+        return static_cast<double>(t - start) / 1e9;
+    };
+
+    /// What each reader saw, kept to itself until it's done.
+    struct Tally {
+        std::uint64_t statuses[STATUSES] = {};
+        std::uint64_t wrong = 0;
+        Nanoseconds firstWrong = 0;
+    };
+    std::vector<Tally> tallies(READERS);
+    std::atomic<unsigned> started{0};
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < READERS; ++r) {
+        readers.emplace_back([&, r] {
+            auto &tally = tallies[r];
+            std::mt19937 gen(params.seed + r);
+            /// From a few samples before the oldest held to past the
+            /// horizon.
+            const auto span =
+                static_cast<Nanoseconds>(CAPACITY + 8) * period;
+            Nanoseconds newest = 0;
+            Eigen::Vector3d xlate, expectedXlate;
+            Eigen::Quaterniond rot, expectedRot;
+            started++;
+            while (!done.load(std::memory_order_acquire)) {
+                if (!buffer.latest(newest, xlate, rot)) {
+                    continue;
+                }
+                const auto tv = newest + extrapolation.maxHorizon + period -
+                                static_cast<Nanoseconds>(gen() % span);
+                const auto status = buffer(tv, xlate, rot);
+                tally.statuses[static_cast<int>(status)]++;
+                if (status != Status::Successful &&
+                    status != Status::Extrapolated) {
+                    continue;
+                }
+                linearPose(params, seconds(tv), expectedXlate, expectedRot);
+                if ((xlate - expectedXlate).norm() > TOLERANCE ||
+                    rot.angularDistance(expectedRot) > TOLERANCE) {
+                    if (tally.wrong++ == 0) {
+                        tally.firstWrong = tv;
+                    }
+                }
+            }
+        });
+    }
+
+    /// Don't have it all pushed before they're even looking.
+    while (started.load() < READERS) {
+        std::this_thread::yield();
+    }
+    Eigen::Vector3d xlate;
+    Eigen::Quaterniond rot;
+    for (std::uint64_t k = 0; k < samples; ++k) {
+        const auto t = start + static_cast<Nanoseconds>(k) * period;
+        linearPose(params, seconds(t), xlate, rot);
+        buffer.push(t, xlate, rot);
+    }
+    done.store(true, std::memory_order_release);
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    Tally total;
+    for (auto const &tally : tallies) {
+        for (std::size_t i = 0; i < STATUSES; ++i) {
+            total.statuses[i] += tally.statuses[i];
+        }
+        if (tally.wrong && !total.wrong) {
+            total.firstWrong = tally.firstWrong;
+        }
+        total.wrong += tally.wrong;
+    }
+    auto count = [&](Status status) {
+        return total.statuses[static_cast<int>(status)];
+    };
+    std::cerr << "Pushed " << samples << " samples; queries: "
+              << count(Status::Successful) << " interpolated, "
+              << count(Status::Extrapolated) << " extrapolated, "
+              << count(Status::BeforeRecordedTrackerData) << " before, "
+              << count(Status::AfterRecordedTrackerData) << " after, "
+              << count(Status::OutOfData) << " out of data, "
+              << count(Status::OtherUnexpectedFailure) << " failed."
+              << std::endl;
+    if (total.wrong) {
+        std::cerr << total.wrong << " wrong poses, the first at "
+                  << motionsynth::toMicroseconds(total.firstWrong)
+                  << " usec." << std::endl;
+        return false;
+    }
+    if (count(Status::Successful) == 0) {
+        std::cerr << "No query got a pose: make the duration longer."
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage();
+        return -1;
+    }
+    if (opts.stressLiveBuffer) {
+        return stressLiveBuffer(opts.params) ? 0 : -1;
+    }
+    const auto trackerCSV = synthetic::trackerCSV(opts.params);
+    const auto referenceCSV = synthetic::referenceCSV(opts.params);
+    if (!opts.trackerOutFn.empty()) {
+        std::ofstream tracker(opts.trackerOutFn, std::ios::binary);
+        tracker << trackerCSV;
+        std::ofstream reference(opts.referenceOutFn, std::ios::binary);
+        reference << referenceCSV;
+        if (!tracker || !reference) {
+            std::cerr << "Error writing the data files." << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    const auto trackerLines = dataLines(trackerCSV);
+    const auto referenceLines = dataLines(referenceCSV);
+    if (trackerLines.size() < 2) {
+        std::cerr << "Need at least two tracker samples: make the duration "
+                     "or tracker rate larger."
+                  << std::endl;
+        return -1;
+    }
+    TrackerStore store;
+    {
+        csvtools::MappedLineSource lines(trackerCSV.data(), trackerCSV.size());
+        csvtools::StringRef header;
+        lines.getLine(header);
+        CSVTrackerSource source(lines);
+        store.loadFrom(source);
+    }
+    std::vector<Nanoseconds> referenceTimes;
+    {
+        csvtools::FieldSpans spans;
+        for (auto const &line : referenceLines) {
+            Nanoseconds tv = 0;
+            motionsynth::parseTimestamp(line, spans, tv);
+            referenceTimes.push_back(tv);
+        }
+    }
+
+    std::vector<Result> results;
+    results.push_back(run("getFields", opts.minTime, [&] {
+        Work work = {0, 0};
+        for (auto const &line : trackerLines) {
+            auto fields = csvtools::getFields(
+                line, CSVTrackerSource::FIELDS_IN_TRACKER_DATA);
+            g_sink = g_sink + fields.size();
+            work.items++;
+            work.bytes += line.size() + 1;
+        }
+        return work;
+    }));
+    results.push_back(run("getCleanLine", opts.minTime, [&] {
+        Work work = {0, trackerCSV.size()};
+        std::istringstream is(trackerCSV);
+        std::string line;
+        while (csvtools::getCleanLine(is, line)) {
+            g_sink = g_sink + line.size();
+            work.items++;
+        }
+        return work;
+    }));
+    results.push_back(run("readTrackerPose", opts.minTime, [&] {
+        Work work = {0, trackerCSV.size()};
+        csvtools::MappedLineSource lines(trackerCSV.data(), trackerCSV.size());
+        csvtools::StringRef header;
+        lines.getLine(header);
+        CSVTrackerSource source(lines);
+        Nanoseconds tv = 0;
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+        while (source.readPose(tv, xlate, rot)) {
+            g_sink = g_sink + static_cast<std::uint64_t>(tv);
+            work.items++;
+        }
+        return work;
+    }));
+    results.push_back(run("getInterpolation", opts.minTime, [&] {
+        Work work = {0, 0};
+        StoreTrackerSource source(store);
+        MotionSynthesizer app(source);
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+        for (auto tv : referenceTimes) {
+            if (app(tv, xlate, rot) == Status::OutOfData) {
+                break;
+            }
+            g_sink = g_sink + static_cast<std::uint64_t>(rot.w() > 0);
+            work.items++;
+        }
+        return work;
+    }));
+    results.push_back(run("livePoseQuery", opts.minTime, [&] {
+        Work work = {0, 0};
+        motionsynth::LivePoseBuffer buffer(256);
+        Eigen::Vector3d xlate;
+        Eigen::Quaterniond rot;
+        for (std::size_t i = 0; i < store.size(); ++i) {
+            buffer.push(store.timestamp(i), store.xlate(i), store.rot(i));
+            if (i == 0) {
+                continue;
+            }
+            /// Halfway back to the sample before, as for a display time.
+            const auto tv = store.timestamp(i) -
+                            (store.timestamp(i) - store.timestamp(i - 1)) / 2;
+            if (buffer(tv, xlate, rot) != Status::Successful) {
+                break;
+            }
+            g_sink = g_sink + static_cast<std::uint64_t>(rot.w() > 0);
+            work.items++;
+        }
+        return work;
+    }));
+    results.push_back(run("endToEnd", opts.minTime, [&] {
+        Work work = {referenceLines.size(),
+                     trackerCSV.size() + referenceCSV.size()};
+        csvtools::MappedLineSource trackerRows(trackerCSV.data(),
+                                               trackerCSV.size());
+        csvtools::MappedLineSource referenceRows(referenceCSV.data(),
+                                                 referenceCSV.size());
+        csvtools::StringRef header;
+        trackerRows.getLine(header);
+        referenceRows.getLine(header);
+        CSVTrackerSource source(trackerRows);
+        MotionSynthesizer app(source);
+        csvtools::BufferedWriter output(NULL_DEVICE);
+        std::ostringstream messages;
+        motionsynth::RowDiagnostics diagnostics(messages);
+        motionsynth::BatchWriter<csvtools::BufferedWriter> writer(
+            output, numformat::DoubleFormat(), diagnostics, messages);
+        csvtools::FieldSpans timestampFields;
+        ReferenceBatch batch;
+        do {
+            fillBatch(referenceRows, timestampFields, batch);
+            batch.interpolate(app);
+            if (!writer.writeRows(batch)) {
+                break;
+            }
+        } while (!batch.stopped());
+        output.flush();
+        g_sink = g_sink + output.bytesWritten();
+        return work;
+    }));
+
+    if (opts.jsonFn.empty()) {
+        writeJSON(std::cout, opts.params, results);
+    } else {
+        std::ofstream os(opts.jsonFn);
+        writeJSON(os, opts.params, results);
+        if (!os) {
+            std::cerr << "Error writing " << opts.jsonFn << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+# Converts generated tracker data whose last line has no newline to the
+# binary format, and fails unless motion-synthesizer gives the same output
+# from either. Then checks that convert fails, rather than writing a file
+# that looks whole, on a tracker CSV that ends in a line that isn't a sample.
+#
+# Run with cmake -P, defining SYNTHESIZER and BENCH (paths to the two
+# executables) and WORK_DIR.
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+execute_process(
+    COMMAND "${BENCH}" --duration 10 --write-data generated.csv reference.csv
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Generating the data failed: ${result}")
+endif()
+file(READ "${WORK_DIR}/generated.csv" tracker)
+string(REGEX REPLACE "\n$" "" tracker "${tracker}")
+file(WRITE "${WORK_DIR}/tracker.csv" "${tracker}")
+
+execute_process(
+    COMMAND "${SYNTHESIZER}" convert tracker.csv tracker.bin
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result
+    ERROR_QUIET)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Converting the tracker data failed: ${result}")
+endif()
+
+foreach(input csv bin)
+    file(REMOVE "${WORK_DIR}/outData.csv")
+    execute_process(
+        COMMAND "${SYNTHESIZER}" tracker.${input} reference.csv
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE result
+        OUTPUT_QUIET
+        ERROR_QUIET
+        TIMEOUT 120)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "The run on the ${input} data failed: ${result}")
+    endif()
+    file(RENAME "${WORK_DIR}/outData.csv" "${WORK_DIR}/from-${input}.csv")
+endforeach()
+
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -E compare_files from-csv.csv from-bin.csv
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Output from the CSV and converted data differ")
+endif()
+
+file(WRITE "${WORK_DIR}/cut-short.csv" "${tracker}\n1458000010,5")
+execute_process(
+    COMMAND "${SYNTHESIZER}" convert cut-short.csv cut-short.bin
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result
+    ERROR_QUIET)
+if(result EQUAL 0)
+    message(FATAL_ERROR "Converting tracker data cut short didn't fail")
+endif()
@@ -0,0 +1,46 @@
+# Runs motion-synthesizer on generated data both serially and with
+# --parallel, and fails unless the outputs are the same. The generated
+# reference rows start before the tracker data, so the first chunk has rows
+# to skip before its tracker interval, and there are enough to make several
+# chunks.
+#
+# Run with cmake -P, defining SYNTHESIZER and BENCH (paths to the two
+# executables) and WORK_DIR.
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+execute_process(
+    COMMAND "${BENCH}" --duration 120 --reference-rate 2000
+            --write-data tracker.csv reference.csv
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Generating the data failed: ${result}")
+endif()
+
+foreach(mode serial parallel)
+    if(mode STREQUAL "parallel")
+        set(args --parallel 4)
+    else()
+        set(args)
+    endif()
+    file(REMOVE "${WORK_DIR}/outData.csv")
+    execute_process(
+        COMMAND "${SYNTHESIZER}" ${args} tracker.csv reference.csv
+        WORKING_DIRECTORY "${WORK_DIR}"
+        RESULT_VARIABLE result
+        OUTPUT_QUIET
+        ERROR_QUIET
+        TIMEOUT 120)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "The ${mode} run failed: ${result}")
+    endif()
+    file(RENAME "${WORK_DIR}/outData.csv" "${WORK_DIR}/${mode}.csv")
+endforeach()
+
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -E compare_files serial.csv parallel.csv
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Serial and --parallel output differ")
+endif()
@@ -23,33 +23,131 @@
 // limitations under the License.
 
 // Internal Includes
+#include "BinaryTracker.h"
+#include "BufferedWriter.h"
 #include "CSVTools.h"
+#include "Instrumentation.h"
+#include "LineSource.h"
+#include "LiveInput.h"
+#include "MappedFile.h"
+#include "MotionSynthesizer.h"
+#include "NumericFormatting.h"
+#include "NumericParsing.h"
+#include "ParallelFor.h"
+#include "RandomAccessInterpolator.h"
+#include "ReferenceRows.h"
+#include "SPSCQueue.h"
+#include "TrackerSource.h"
+#include "TrackerStore.h"
 
 // Library/third-party includes
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
-#include <osvr/Util/TimeValue.h>
-
 // Standard includes
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <ratio>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
-using osvr::util::time::TimeValue;
+using motionsynth::BatchWriter;
+using motionsynth::BinaryTrackerSource;
+using motionsynth::CSVTrackerSource;
+using motionsynth::MappedCSVTrackerSource;
+using motionsynth::MotionSynthesizer;
+using motionsynth::NUM_TIMESTAMP_FIELDS;
+using motionsynth::Nanoseconds;
+using motionsynth::RandomAccessInterpolator;
+using motionsynth::ReferenceBatch;
+using motionsynth::RowDiagnostics;
+using motionsynth::Status;
+using motionsynth::TrackerSource;
+using motionsynth::TrackerStore;
 using csvtools::COMMA_CHAR;
 using csvtools::DOUBLEQUOTE_CHAR;
+namespace binary_tracker = motionsynth::binary_tracker;
 
 void usage() {
     std::cerr << "Must pass the CSV file containing the tracker reports, then "
                  "the CSV file containing other data that you'd like to "
                  "interpolate the tracker based on."
               << std::endl;
+    std::cerr << "Options (before the file names):\n"
+                 "  --mmap       Memory-map the input files instead of "
+                 "reading them as streams.\n"
+                 "  --hugepages  Like --mmap, also requesting huge pages for "
+                 "the mappings.\n"
+                 "  --random-access  Load all tracker data up front so "
+                 "reference rows may come\n"
+                 "                   in any order. With --mmap, CSV tracker "
+                 "data is loaded\n"
+                 "                   on several threads (as many as "
+                 "--parallel says, if given).\n"
+                 "  --pipeline   Read, interpolate and write on separate "
+                 "threads.\n"
+                 "  --parallel <threads>  Split the time reference file into "
+                 "chunks and\n"
+                 "                  process them on this many threads (0: one "
+                 "per core).\n"
+                 "                  Implies --mmap.\n"
+                 "  --skip-ahead  Binary-search the time reference file for "
+                 "the first row\n"
+                 "                  at or after the start of the tracker data "
+                 "instead of\n"
+                 "                  reading the rows before it. The rows must "
+                 "be in time\n"
+                 "                  order, so not with --random-access. "
+                 "Implies --mmap.\n"
+                 "  --stream     Read the inputs as they come in - from pipes, "
+                 "FIFOs, standard\n"
+                 "                  input (-) or files still being written - "
+                 "and write each\n"
+                 "                  row as soon as the tracker data after it "
+                 "is in. Can't be\n"
+                 "                  combined with the options above.\n"
+                 "  --max-wait <ms>  With --stream, how long to wait for more "
+                 "of an input\n"
+                 "                  before taking it as ended (default 2000).\n"
+                 "  --output-buffer <bytes>  Size of the output buffer "
+                 "(default 4 MiB).\n"
+                 "  --decimals <n>  Write interpolated values with n fixed "
+                 "decimals (0-15)\n"
+                 "                  instead of the shortest exact form.\n"
+                 "  --nlerp-max-error <degrees>  Use normalized lerp instead "
+                 "of slerp for\n"
+                 "                  tracker intervals where its rotation error "
+                 "stays under\n"
+                 "                  this (not with --random-access).\n"
+                 "  --extrapolate <ms>  Predict poses for reference rows up "
+                 "to this far past\n"
+                 "                  the tracker data, at its last velocity, "
+                 "instead of\n"
+                 "                  stopping there - or, with --stream, "
+                 "waiting for more.\n"
+                 "                  Adds an \"extrapolated\" column (1 or 0) "
+                 "after the pose\n"
+                 "                  (not with --random-access).\n"
+                 "  --extrapolation-window <n>  Average the velocity over the "
+                 "last n tracker\n"
+                 "                  intervals (default 1).\n"
+                 "The tracker data may also be a binary file made with:\n"
+                 "  motion-synthesizer convert <tracker CSV> <binary output>"
+              << std::endl;
     std::cerr << "Press enter to exit..." << std::endl;
 }
 
@@ -59,7 +157,6 @@ int errorExitAfterUsagePrint() {
     return -1;
 }
 
-static const auto NUM_TIMESTAMP_FIELDS = 2;
 static const std::array<std::string, NUM_TIMESTAMP_FIELDS> TIMESTAMP_HEADERS = {
     "sec", "usec"};
 static const std::vector<std::string> TRACKER_HEADERS = {TIMESTAMP_HEADERS[0],
@@ -71,246 +168,907 @@ static const std::vector<std::string> TRACKER_HEADERS = {TIMESTAMP_HEADERS[0],
                                                          "qx",
                                                          "qy",
                                                          "qz"};
-namespace {
-using MicrosecIntType = std::int32_t;
-inline MicrosecIntType microsecondsDifference(TimeValue const &a,
-                                              TimeValue const &b) {
-    return static_cast<MicrosecIntType>(a.seconds - b.seconds) *
-               std::micro::den +
-           (a.microseconds - b.microseconds);
-}
+struct Options {
+    bool mmap = false;
+    csvtools::MapHints mapHints;
+    std::size_t outputBufferSize =
+        csvtools::BufferedWriter::DEFAULT_BUFFER_SIZE;
+    numformat::DoubleFormat doubleFormat;
+    bool randomAccess = false;
+    bool pipelined = false;
+    /// Worker threads for processing the reference file in chunks, or 0 to
+    /// process it in one go.
+    std::size_t workers = 0;
+    /// Whether to jump straight to the reference rows from the start of the
+    /// tracker data on.
+    bool skipAhead = false;
+    /// Whether to read the inputs as they're still being written.
+    bool stream = false;
+    /// How long to wait for more of a streamed input before giving up on it.
+    std::chrono::milliseconds maxWait = std::chrono::milliseconds(2000);
+    motionsynth::RotationPolicy rotationPolicy;
+    motionsynth::ExtrapolationPolicy extrapolation;
+    std::string trackerFn;
+    std::string timeRefFn;
+};
 
-inline std::ostream &operator<<(std::ostream &os, TimeValue const &tv) {
-    os << tv.seconds << ":" << tv.microseconds;
-    return os;
+/// Returns false if the command line couldn't be understood.
+bool parseOptions(int argc, char *argv[], Options &opts) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mmap") {
+            opts.mmap = true;
+        } else if (arg == "--hugepages") {
+            opts.mmap = true;
+            opts.mapHints.hugePages = true;
+        } else if (arg == "--random-access") {
+            opts.randomAccess = true;
+        } else if (arg == "--pipeline") {
+            opts.pipelined = true;
+        } else if (arg == "--parallel") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a number of threads"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            if (!numparse::parse(val.data(), val.data() + val.size(),
+                                 opts.workers)) {
+                std::cerr << "Bad number of threads " << val << std::endl;
+                return false;
+            }
+            if (opts.workers == 0) {
+                opts.workers = parallel::defaultThreads();
+            }
+            // chunks are found in, and read from, mappings.
+            opts.mmap = true;
+        } else if (arg == "--skip-ahead") {
+            opts.skipAhead = true;
+            // the search needs the whole file at hand.
+            opts.mmap = true;
+        } else if (arg == "--stream") {
+            opts.stream = true;
+        } else if (arg == "--max-wait") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a time in milliseconds"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            std::uint32_t ms = 0;
+            if (!numparse::parse(val.data(), val.data() + val.size(), ms)) {
+                std::cerr << "Bad maximum wait " << val << std::endl;
+                return false;
+            }
+            opts.maxWait = std::chrono::milliseconds(ms);
+        } else if (arg == "--output-buffer") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a size in bytes" << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            if (!numparse::parse(val.data(), val.data() + val.size(),
+                                 opts.outputBufferSize) ||
+                opts.outputBufferSize == 0) {
+                std::cerr << "Bad output buffer size " << val << std::endl;
+                return false;
+            }
+        } else if (arg == "--decimals") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a number of decimals"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            int decimals = 0;
+            if (!numparse::parse(val.data(), val.data() + val.size(),
+                                 decimals) ||
+                decimals < 0 || decimals > numformat::MAX_FIXED_DECIMALS) {
+                std::cerr << "Bad number of decimals " << val << std::endl;
+                return false;
+            }
+            opts.doubleFormat.mode = numformat::DoubleFormat::Fixed;
+            opts.doubleFormat.decimals = decimals;
+        } else if (arg == "--nlerp-max-error") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires an angle in degrees"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            double degrees = 0;
+            if (!numparse::parse(val.data(), val.data() + val.size(),
+                                 degrees) ||
+                !(degrees >= 0)) {
+                std::cerr << "Bad nlerp error threshold " << val << std::endl;
+                return false;
+            }
+            opts.rotationPolicy.maxNlerpError = degrees * EIGEN_PI / 180.;
+        } else if (arg == "--extrapolate") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a time in milliseconds"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            double ms = 0;
+            if (!numparse::parse(val.data(), val.data() + val.size(), ms) ||
+                !(ms >= 0) || ms > 1e9) {
+                std::cerr << "Bad extrapolation horizon " << val << std::endl;
+                return false;
+            }
+            opts.extrapolation.maxHorizon =
+                static_cast<Nanoseconds>(ms * 1e6 + 0.5);
+        } else if (arg == "--extrapolation-window") {
+            if (i + 1 == argc) {
+                std::cerr << arg << " requires a number of intervals"
+                          << std::endl;
+                return false;
+            }
+            std::string val = argv[++i];
+            if (!numparse::parse(val.data(), val.data() + val.size(),
+                                 opts.extrapolation.window) ||
+                opts.extrapolation.window == 0) {
+                std::cerr << "Bad extrapolation window " << val << std::endl;
+                return false;
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unrecognized option " << arg << std::endl;
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2) {
+        return false;
+    }
+    if (opts.randomAccess && opts.rotationPolicy.maxNlerpError > 0) {
+        std::cerr << "--nlerp-max-error only applies to sequential "
+                     "interpolation, not --random-access"
+                  << std::endl;
+        return false;
+    }
+    if (opts.randomAccess && opts.extrapolation.maxHorizon > 0) {
+        std::cerr << "--extrapolate only applies to sequential interpolation, "
+                     "not --random-access"
+                  << std::endl;
+        return false;
+    }
+    if (opts.randomAccess && opts.skipAhead) {
+        std::cerr << "--skip-ahead needs the reference rows in time order, "
+                     "which --random-access doesn't"
+                  << std::endl;
+        return false;
+    }
+    if (opts.pipelined && opts.workers > 0) {
+        std::cerr << "Use only one of --pipeline and --parallel" << std::endl;
+        return false;
+    }
+    if (opts.stream &&
+        (opts.mmap || opts.randomAccess || opts.pipelined)) {
+        std::cerr << "--stream reads the inputs as they come, so it can't be "
+                     "combined with mapping, random access, pipelining, "
+                     "chunking or skipping ahead"
+                  << std::endl;
+        return false;
+    }
+    opts.trackerFn = positional[0];
+    opts.timeRefFn = positional[1];
+    if (opts.trackerFn == "-" && opts.timeRefFn == "-") {
+        std::cerr << "Only one of the inputs can be standard input"
+                  << std::endl;
+        return false;
+    }
+    return true;
 }
 
-enum class Status {
-    BeforeRecordedTrackerData,
-    Successful,
-    OutOfData,
-    OtherUnexpectedFailure
+/// An input file opened according to the options, along with the line source
+/// reading from it.
+struct InputFile {
+    std::ifstream stream;
+    csvtools::MappedFile mapping;
+    std::unique_ptr<csvtools::LineSource> lines;
+    /// The line source, if reading from the mapping.
+    csvtools::MappedLineSource *mappedLines = nullptr;
+    csvtools::LiveInput live;
+    /// The line source, if reading as a stream.
+    csvtools::LiveLineSource *liveLines = nullptr;
 };
-class MotionSynthesizer {
-  public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-    MotionSynthesizer(std::istream &trackerData) : trackerData_(trackerData) {
-        if (!readTrackerPose(start_, startXlate_, startRot_)) {
-            throw std::runtime_error("Could not read the initial data row "
-                                     "from the tracker data!");
-        }
-        if (!readTrackerPose(end_, endXlate_, endRot_)) {
-            throw std::runtime_error("Could not read the second data row "
-                                     "from the tracker data!");
-        }
-        updateCachedIntervalData();
-    }
-    bool outOfData() const { return done_; }
-
-    /// Feed me with SEQUENTIAL TimeValue structs and I'll give you interpolated
-    /// data for them, modulo some caveats.
-    Status operator()(TimeValue const &tv, Eigen::Vector3d &outXlate,
-                      Eigen::Quaterniond &outRot) {
-        if (isBeforeTrackerData(tv)) {
-            return Status::BeforeRecordedTrackerData;
-        }
-        /// Might need to be advanced several times...
-        while (trackerDataNeedsAdvancing(tv)) {
-            // std::cerr << "Advanced the tracker data!" << std::endl;
-            if (!advanceTrackerData()) {
-                return Status::OutOfData;
-            }
+
+bool openInput(std::string const &fn, Options const &opts, InputFile &input) {
+    if (opts.stream) {
+        if (!input.live.open(fn)) {
+            return false;
         }
-        if (outOfData()) {
-            return Status::OutOfData;
+        input.liveLines =
+            new csvtools::LiveLineSource(input.live, opts.maxWait);
+        input.lines.reset(input.liveLines);
+    } else if (opts.mmap) {
+        if (!input.mapping.open(fn, opts.mapHints)) {
+            return false;
         }
-        auto result = getInterpolation(tv, outXlate, outRot);
-        if (!result) {
-            return Status::OtherUnexpectedFailure;
+        input.mappedLines = new csvtools::MappedLineSource(input.mapping);
+        input.lines.reset(input.mappedLines);
+    } else {
+        input.stream.open(fn);
+        if (!input.stream) {
+            return false;
         }
-        return Status::Successful;
+        input.lines.reset(new csvtools::StreamLineSource(input.stream));
     }
+    return true;
+}
 
-    TimeValue const &getStartTime() const { return start_; };
-    TimeValue const &getEndTime() const { return end_; };
+/// For --skip-ahead: offset of the first of the mapped reference rows from
+/// begin on that's not before start, noting how many were skipped. Those
+/// rows are only counted, not parsed.
+std::size_t skipReferenceRows(csvtools::MappedFile const &ref,
+                              std::size_t begin, Nanoseconds start) {
+    const auto pos =
+        motionsynth::firstRowAtOrAfter(ref.data(), begin, ref.size(), start);
+    std::cout << "Skipped "
+              << std::count(ref.data() + begin, ref.data() + pos, '\n')
+              << " reference rows before the tracker data starts at "
+              << motionsynth::fromNanoseconds(start) << std::endl;
+    return pos;
+}
 
-  private:
-    bool isBeforeTrackerData(TimeValue const &tv) const { return tv < start_; }
-    bool trackerDataNeedsAdvancing(TimeValue const &tv) const {
-        return end_ < tv;
-    }
-    void updateCachedIntervalData() {
-        intervalDuration_ = microsecondsDifference(end_, start_);
-        incXlate_ = endXlate_ - startXlate_;
-    }
-    bool getInterpolation(TimeValue const &tv, Eigen::Vector3d &outXlate,
-                          Eigen::Quaterniond &outRot) const {
-        if (tv == start_) {
-            /// right on the start.
-            outXlate = startXlate_;
-            outRot = startRot_;
-            return true;
-        }
-        if (tv == end_) {
-            /// right on the end.
-            outXlate = endXlate_;
-            outRot = endRot_;
-            return true;
-        }
-        if (isBeforeTrackerData(tv) || trackerDataNeedsAdvancing(tv)) {
-            /// can't interpolate here.
-            return false;
+/// Same, moving the reference file's line source along.
+void skipReferenceRows(InputFile &timeRefData, Nanoseconds start) {
+    auto &lines = *timeRefData.mappedLines;
+    lines.seek(skipReferenceRows(timeRefData.mapping, lines.position(), start));
+}
+
+/// Reads the rest of the reference rows, writing each along with the tracker
+/// pose interpolated at its timestamp, until out of either. Rows are read and
+/// interpolated a batch at a time.
+template <typename Engine>
+void processReferenceRows(Engine &app, csvtools::LineSource &timeRefLines,
+                          csvtools::BufferedWriter &output,
+                          Options const &opts) {
+    csvtools::FieldSpans timestampFields;
+    ReferenceBatch batch;
+    RowDiagnostics diagnostics(std::cout);
+    BatchWriter<csvtools::BufferedWriter> writer(output, opts.doubleFormat,
+                                                 diagnostics);
+    writer.flagExtrapolated(opts.extrapolation.maxHorizon > 0);
+    do {
+        fillBatch(timeRefLines, timestampFields, batch);
+        batch.interpolate(app);
+    } while (writer.write(batch));
+}
+
+/// Number of batches in flight in the pipeline, which is also as far as one
+/// stage can get ahead of the next before it has to wait.
+static const std::size_t PIPELINE_DEPTH = 8;
+
+void printStageStats(const char *name, pipeline::StageStats const &stats) {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cerr << "Pipeline stage " << name << ": " << stats.batches
+              << " batches, busy " << ms(stats.busy).count()
+              << " ms, waiting for input "
+              << ms(stats.waitingForInput).count()
+              << " ms, waiting for output "
+              << ms(stats.waitingForOutput).count() << " ms ("
+              << 100. * stats.utilization() << "% utilized)." << std::endl;
+}
+
+/// Same as processReferenceRows, but with reading and parsing, interpolating,
+/// and formatting and writing each on their own thread. Batches go around a
+/// ring of lock-free queues: reader to interpolator to writer, then back to
+/// the reader to be refilled, so a stage that gets ahead waits for the
+/// others to hand back a batch.
+template <typename Engine>
+void processReferenceRowsPipelined(Engine &app,
+                                   csvtools::LineSource &timeRefLines,
+                                   csvtools::BufferedWriter &output,
+                                   Options const &opts) {
+    using pipeline::SPSCQueue;
+    using pipeline::StageStats;
+    std::vector<std::unique_ptr<ReferenceBatch>> batches;
+    SPSCQueue<ReferenceBatch *> emptyBatches(PIPELINE_DEPTH);
+    SPSCQueue<ReferenceBatch *> readBatches(PIPELINE_DEPTH);
+    SPSCQueue<ReferenceBatch *> interpolatedBatches(PIPELINE_DEPTH);
+    for (std::size_t i = 0; i < PIPELINE_DEPTH; ++i) {
+        batches.emplace_back(new ReferenceBatch);
+        emptyBatches.tryPush(batches.back().get());
+    }
+
+    /// Any stage that fails closes every queue, so the others stop too.
+    std::exception_ptr error[2];
+    auto closeAll = [&] {
+        emptyBatches.close();
+        readBatches.close();
+        interpolatedBatches.close();
+    };
+
+    StageStats readStats;
+    std::thread reader([&] {
+        const auto begin = StageStats::clock::now();
+        try {
+            csvtools::FieldSpans timestampFields;
+            ReferenceBatch *batch = nullptr;
+            while (emptyBatches.pop(batch, readStats.waitingForInput)) {
+                fillBatch(timeRefLines, timestampFields, *batch);
+                readStats.batches++;
+                if (!readBatches.push(batch, readStats.waitingForOutput) ||
+                    batch->stopped()) {
+                    break;
+                }
+            }
+            readBatches.close();
+        } catch (...) {
+            error[0] = std::current_exception();
+            closeAll();
         }
-        auto tvSinceStart = microsecondsDifference(tv, start_);
-        auto t = static_cast<double>(tvSinceStart) / intervalDuration_;
-
-        /// Slerp the rotation
-        outRot = startRot_;
-        outRot.slerp(t, endRot_);
-
-        /// Lerp the translation
-        outXlate = startXlate_ + t * incXlate_;
-        return true;
-    }
-    /// move us along another row - false if no such thing possible.
-    bool advanceTrackerData() {
-        start_ = end_;
-        startXlate_ = endXlate_;
-        startRot_ = endRot_;
-        if (!readTrackerPose(end_, endXlate_, endRot_)) {
-            // couldn't read another line - out of data
-            done_ = true;
-            return false;
+        readStats.busy = StageStats::clock::now() - begin -
+                         readStats.waitingForInput -
+                         readStats.waitingForOutput;
+    });
+
+    StageStats interpolateStats;
+    std::thread interpolator([&] {
+        const auto begin = StageStats::clock::now();
+        try {
+            ReferenceBatch *batch = nullptr;
+            while (readBatches.pop(batch, interpolateStats.waitingForInput)) {
+                batch->interpolate(app);
+                interpolateStats.batches++;
+                if (!interpolatedBatches.push(
+                        batch, interpolateStats.waitingForOutput)) {
+                    break;
+                }
+            }
+            interpolatedBatches.close();
+        } catch (...) {
+            error[1] = std::current_exception();
+            closeAll();
         }
-        updateCachedIntervalData();
-        return true;
-    }
-    /// utility
-    bool readTrackerPose(TimeValue &tv, Eigen::Vector3d &xlate,
-                         Eigen::Quaterniond &rot) {
-        if (!trackerData_) {
-            return false;
+        interpolateStats.busy = StageStats::clock::now() - begin -
+                                interpolateStats.waitingForInput -
+                                interpolateStats.waitingForOutput;
+    });
+
+    StageStats writeStats;
+    {
+        const auto begin = StageStats::clock::now();
+        try {
+            RowDiagnostics diagnostics(std::cout);
+            BatchWriter<csvtools::BufferedWriter> writer(
+                output, opts.doubleFormat, diagnostics);
+            writer.flagExtrapolated(opts.extrapolation.maxHorizon > 0);
+            ReferenceBatch *batch = nullptr;
+            while (interpolatedBatches.pop(batch,
+                                           writeStats.waitingForInput)) {
+                writeStats.batches++;
+                if (!writer.write(*batch)) {
+                    break;
+                }
+                // never waits: it has room for every batch there is.
+                emptyBatches.push(batch, writeStats.waitingForOutput);
+            }
+        } catch (...) {
+            closeAll();
+            reader.join();
+            interpolator.join();
+            throw;
         }
-        auto line = csvtools::getCleanLine(trackerData_);
-        if (!trackerData_) {
-            return false;
+        /// Done with the rest, whether or not they were.
+        closeAll();
+        writeStats.busy = StageStats::clock::now() - begin -
+                          writeStats.waitingForInput -
+                          writeStats.waitingForOutput;
+    }
+    reader.join();
+    interpolator.join();
+    for (auto &e : error) {
+        if (e) {
+            std::rethrow_exception(e);
         }
+    }
+    printStageStats("read", readStats);
+    printStageStats("interpolate", interpolateStats);
+    printStageStats("write", writeStats);
+}
 
-        fieldsTemp_ = csvtools::getFields(line, FIELDS_IN_TRACKER_DATA);
-        enum {
-            Sec = 0,
-            Usec = 1,
-            TX = 2,
-            TY = 3,
-            TZ = 4,
-            QW = 5,
-            QX = 6,
-            QY = 7,
-            QZ = 8
-        };
+/// For --stream: how long the rows written took from the read that brought
+/// them in to the flush that sent them out, kept without a time per row.
+class RowLatency {
+  public:
+    using clock = csvtools::LiveLineSource::clock;
 
-        getField(Sec, tv.seconds);
-        getField(Usec, tv.microseconds);
-        xlate.x() = getFieldAs<double>(TX);
-        xlate.y() = getFieldAs<double>(TY);
-        xlate.z() = getFieldAs<double>(TZ);
-        rot.x() = getFieldAs<double>(QX);
-        rot.y() = getFieldAs<double>(QY);
-        rot.z() = getFieldAs<double>(QZ);
-        rot.w() = getFieldAs<double>(QW);
-        return true;
+    /// A row that came in at arrival was written to the output buffer.
+    void written(clock::time_point arrival) {
+        if (pending_ == 0) {
+            oldest_ = arrival;
+        }
+        pending_++;
+        pendingSinceOldest_ += arrival - oldest_;
+    }
+    /// Everything written so far just went out.
+    void flushed() {
+        if (pending_ == 0) {
+            return;
+        }
+        const auto sinceOldest = clock::now() - oldest_;
+        total_ += sinceOldest * static_cast<clock::rep>(pending_) -
+                  pendingSinceOldest_;
+        max_ = std::max(max_, sinceOldest);
+        rows_ += pending_;
+        flushes_++;
+        pending_ = 0;
+        pendingSinceOldest_ = clock::duration::zero();
     }
 
-    template <typename T> inline bool getField(std::size_t field, T &output) {
-        iss_.clear();
-        iss_.str(fieldsTemp_[field]);
-        return static_cast<bool>(iss_ >> output);
+    void print(std::ostream &os) const {
+        using ms = std::chrono::duration<double, std::milli>;
+        os << "Row latency: " << rows_ << " rows in " << flushes_
+           << " flushes, mean "
+           << (rows_ ? ms(total_).count() / static_cast<double>(rows_) : 0.)
+           << " ms, max " << ms(max_).count() << " ms." << std::endl;
     }
 
-    template <typename T> inline T getFieldAs(std::size_t field) {
-        T ret = 0;
-        iss_.clear();
-        iss_.str(fieldsTemp_[field]);
-        iss_ >> ret;
-        return ret;
+  private:
+    std::uint64_t rows_ = 0;
+    std::uint64_t flushes_ = 0;
+    clock::duration total_ = clock::duration::zero();
+    clock::duration max_ = clock::duration::zero();
+    /// Rows written since the last flush: how many, when the first came in,
+    /// and the sum of how much later the rest did.
+    std::uint64_t pending_ = 0;
+    clock::time_point oldest_;
+    clock::duration pendingSinceOldest_ = clock::duration::zero();
+};
+
+/// Same as processReferenceRows, but for --stream: a row at a time, each
+/// written as soon as the tracker sample after it has come in, which may
+/// mean waiting for it. The output goes out whenever either input has to be
+/// waited for, so a burst of rows costs one write, not one each.
+template <typename Engine>
+void processReferenceRowsLive(Engine &app,
+                              csvtools::LiveLineSource &timeRefLines,
+                              csvtools::LiveLineSource &trackerLines,
+                              csvtools::BufferedWriter &output,
+                              Options const &opts) {
+    RowLatency latency;
+    auto flush = [&] {
+        output.flush();
+        latency.flushed();
+    };
+    timeRefLines.setBeforeWaiting(flush);
+    trackerLines.setBeforeWaiting(flush);
+    csvtools::FieldSpans timestampFields;
+    ReferenceBatch batch;
+    RowDiagnostics diagnostics(std::cout);
+    BatchWriter<csvtools::BufferedWriter> writer(output, opts.doubleFormat,
+                                                 diagnostics);
+    writer.flagExtrapolated(opts.extrapolation.maxHorizon > 0);
+    bool more = true;
+    while (more) {
+        fillBatch(timeRefLines, timestampFields, batch, 1);
+        const auto arrival = timeRefLines.lineArrival();
+        batch.interpolate(app);
+        const auto flushes = output.flushCount();
+        more = writer.write(batch);
+        if (output.flushCount() != flushes) {
+            // the buffer filled up and went out on its own.
+            latency.flushed();
+        }
+        if (batch.size() == 1 && (batch.status(0) == Status::Successful ||
+                                  batch.status(0) == Status::Extrapolated)) {
+            latency.written(arrival);
+        }
     }
+    flush();
+    timeRefLines.setBeforeWaiting(nullptr);
+    trackerLines.setBeforeWaiting(nullptr);
+    latency.print(std::cerr);
+}
 
-    static const auto FIELDS_IN_TRACKER_DATA = 9;
-    std::istream &trackerData_;
+/// For --stream: says so if an input ended for want of more data in time, or
+/// for an error, rather than at its end.
+void reportLiveEnd(const char *name, csvtools::LiveLineSource const &lines,
+                   Options const &opts) {
+    if (lines.failed()) {
+        std::cerr << "Error reading the " << name << "." << std::endl;
+    } else if (lines.timedOut()) {
+        std::cerr << "No more " << name << " after waiting "
+                  << opts.maxWait.count() << " ms, taking it as ended."
+                  << std::endl;
+    }
+}
 
-    TimeValue start_;
-    Eigen::Vector3d startXlate_;
-    Eigen::Quaterniond startRot_;
+/// What one chunk of the reference rows turned into, kept until it's its
+/// turn to be written.
+struct ChunkResult {
+    csvtools::MemoryWriter output;
+    std::string messages;
+    /// Runs of row statuses, to be reported in order with the rest.
+    std::vector<motionsynth::RowRun> runs;
+    bool startedWriting = false;
+    /// Where in the messages the first row was written.
+    std::size_t startedWritingAt = 0;
+    std::uint64_t rows = 0;
+    bool outOfData = false;
+    ReferenceBatch::Stop stop = ReferenceBatch::Stop::NotStopped;
+    std::string badLine;
+    std::size_t badFieldCount = 0;
+    std::exception_ptr error;
+    /// Set, under the lock, once the rest is filled in.
+    bool done = false;
+};
 
-    TimeValue end_;
-    Eigen::Vector3d endXlate_;
-    Eigen::Quaterniond endRot_;
+/// Interpolates and formats the rows of one chunk into its result.
+template <typename Engine>
+void processChunk(Engine &app, csvtools::LineSource &timeRefLines,
+                  ChunkResult &result, Options const &opts) {
+    std::ostringstream messages;
+    RowDiagnostics diagnostics;
+    BatchWriter<csvtools::MemoryWriter> writer(
+        result.output, opts.doubleFormat, diagnostics, messages, false);
+    writer.flagExtrapolated(opts.extrapolation.maxHorizon > 0);
+    csvtools::FieldSpans timestampFields;
+    ReferenceBatch batch;
+    do {
+        fillBatch(timeRefLines, timestampFields, batch);
+        batch.interpolate(app);
+        if (!writer.writeRows(batch)) {
+            result.outOfData = true;
+            break;
+        }
+    } while (!batch.stopped());
+    diagnostics.finish();
+    result.runs = diagnostics.runs();
+    result.messages = messages.str();
+    result.startedWriting = writer.startedWriting();
+    result.startedWritingAt = writer.startedWritingAt();
+    result.rows = writer.rows();
+    result.stop = batch.stop();
+    result.badLine = batch.badLine();
+    result.badFieldCount = batch.badFieldCount();
+}
 
-    bool done_ = false;
+/// Runs each chunk with a sequential engine of its own, with its own cursor
+/// into the tracker data, started at the chunk's first timestamp.
+struct SequentialChunkRunner {
+    std::function<std::unique_ptr<TrackerSource>()> openTracker;
+    motionsynth::RotationPolicy rotationPolicy;
+    motionsynth::ExtrapolationPolicy extrapolation;
+    std::atomic<std::uint64_t> slerpIntervals{0};
+    std::atomic<std::uint64_t> nlerpIntervals{0};
 
-    /// @name Cached interval data
-    /// @{
-    MicrosecIntType intervalDuration_ = 0;
-    Eigen::Vector3d incXlate_;
-    /// @}
+    void operator()(Nanoseconds first, csvtools::LineSource &lines,
+                    ChunkResult &result, Options const &opts) {
+        auto tracker = openTracker();
+        MotionSynthesizer app(*tracker, first, rotationPolicy);
+        app.setExtrapolation(extrapolation);
+        processChunk(app, lines, result, opts);
+        slerpIntervals += app.slerpIntervals();
+        nlerpIntervals += app.nlerpIntervals();
+    }
+};
 
-    std::vector<std::string> fieldsTemp_;
+/// Runs each chunk with a random-access engine on the shared store.
+struct RandomAccessChunkRunner {
+    TrackerStore const &store;
 
-    std::istringstream iss_;
+    void operator()(Nanoseconds /*first*/, csvtools::LineSource &lines,
+                    ChunkResult &result, Options const &opts) const {
+        RandomAccessInterpolator app(store);
+        processChunk(app, lines, result, opts);
+    }
 };
-} // namespace
 
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        return errorExitAfterUsagePrint();
+/// Same as processReferenceRows, but for the rows in [begin, end) of a mapped
+/// reference file, split into chunks at line boundaries. Worker threads
+/// interpolate and format whole chunks with the runner, while this thread
+/// writes their results out in the original order. Workers only get so far
+/// ahead of the writing, so the output waiting in memory stays bounded.
+template <typename Runner>
+void processReferenceChunks(Runner &runner, const char *data,
+                            std::size_t begin, std::size_t end,
+                            csvtools::BufferedWriter &output,
+                            Options const &opts) {
+    const auto workers = opts.workers;
+    const auto chunks = csvtools::chunkCount(end - begin, workers);
+    const auto bounds = csvtools::splitAtLines(data, begin, end, chunks);
+    std::vector<ChunkResult> results(chunks);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t nextChunk = 0;
+    std::size_t written = 0;
+    bool stopping = false;
+    const auto window = 2 * workers;
+    auto work = [&] {
+        csvtools::FieldSpans spans;
+        while (true) {
+            std::size_t i = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] {
+                    return stopping || nextChunk == chunks ||
+                           nextChunk < written + window;
+                });
+                if (stopping || nextChunk == chunks) {
+                    return;
+                }
+                i = nextChunk++;
+            }
+            auto &result = results[i];
+            try {
+                csvtools::MappedLineSource lines(data + bounds[i],
+                                                 bounds[i + 1] - bounds[i]);
+                csvtools::StringRef first;
+                if (lines.getLine(first)) {
+                    Nanoseconds tv = 0;
+                    if (motionsynth::parseTimestamp(first, spans, tv)) {
+                        lines.seek(0);
+                        runner(tv, lines, result, opts);
+                    } else {
+                        /// No time to start the tracker at, but the rows
+                        /// stop right there anyway, as they would serially.
+                        result.stop = ReferenceBatch::Stop::BadRow;
+                        result.badLine = first.str();
+                        result.badFieldCount = spans.size();
+                    }
+                }
+            } catch (...) {
+                result.error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                result.done = true;
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t w = 0; w < workers; ++w) {
+        threads.emplace_back(work);
     }
-    std::ifstream trackerData(argv[1]);
-    if (!trackerData) {
-        std::cerr << "Could not open tracker data file " << argv[1]
-                  << std::endl;
-        return errorExitAfterUsagePrint();
+
+    std::exception_ptr error;
+    std::uint64_t rows = 0;
+    bool startedWriting = false;
+    RowDiagnostics diagnostics(std::cout);
+    auto stop = ReferenceBatch::Stop::NotStopped;
+    std::string badLine;
+    std::size_t badFieldCount = 0;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        auto &result = results[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return result.done; });
+        }
+        if (result.error) {
+            error = result.error;
+            break;
+        }
+        diagnostics.add(result.runs);
+        if (result.startedWriting && !startedWriting) {
+            std::cout << result.messages.substr(0, result.startedWritingAt)
+                      << "Starting to write data rows!" << std::endl
+                      << result.messages.substr(result.startedWritingAt);
+            startedWriting = true;
+        } else {
+            std::cout << result.messages;
+        }
+        std::cout << std::flush;
+        output.write(result.output.data(), result.output.size());
+        result.output.clear();
+        std::string().swap(result.messages);
+        rows += result.rows;
+        if (result.outOfData) {
+            break;
+        }
+        if (result.stop == ReferenceBatch::Stop::BadRow) {
+            stop = result.stop;
+            badLine = result.badLine;
+            badFieldCount = result.badFieldCount;
+            break;
+        }
+        if (i + 1 == chunks) {
+            stop = ReferenceBatch::Stop::OutOfRows;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written = i + 1;
+        }
+        cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
     }
+    cv.notify_all();
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    diagnostics.finish();
+    reportStop(stop, badLine, badFieldCount, rows);
+}
 
-    static const auto FIELDS_IN_TRACKER_DATA = TRACKER_HEADERS.size();
+/// Runs the reference rows through the engine as the options say to.
+template <typename Engine>
+void interpolateReferenceRows(Engine &app, csvtools::LineSource &timeRefLines,
+                              csvtools::BufferedWriter &output,
+                              Options const &opts) {
+    if (opts.pipelined) {
+        processReferenceRowsPipelined(app, timeRefLines, output, opts);
+    } else {
+        processReferenceRows(app, timeRefLines, output, opts);
+    }
+}
 
-    // Verify at least the first line of the tracker file to make sure it's what
-    // we expect.
-    {
-        auto trackerHeaders = csvtools::getFields(
-            csvtools::getCleanLine(trackerData), FIELDS_IN_TRACKER_DATA);
-        if (trackerHeaders.size() != FIELDS_IN_TRACKER_DATA) {
-            std::cerr
-                << "Couldn't get " << FIELDS_IN_TRACKER_DATA
-                << " headings from the first line of the tracker data file."
-                << std::endl;
-            return errorExitAfterUsagePrint();
-        }
+/// Loads all of the tracker data for random access: straight out of the
+/// mapping on several threads for a mapped CSV file, otherwise through the
+/// source one sample at a time. The header must already have been checked.
+void loadTrackerStore(TrackerStore &store, TrackerSource &source,
+                      InputFile const &trackerData, Options const &opts) {
+    std::size_t n = 0;
+    auto const &mapping = trackerData.mapping;
+    if (mapping) {
+        const auto body =
+            csvtools::lineStartAtOrAfter(mapping.data(), mapping.size(), 1);
+        n = store.loadCSV(mapping.data(), body, mapping.size(), opts.workers);
+    } else {
+        n = store.loadFrom(source);
+    }
+    std::cerr << "Loaded " << n << " tracker samples." << std::endl;
+}
 
-        csvtools::stripQuotes(trackerHeaders);
+/// Verify at least the first line of the tracker file to make sure it's what
+/// we expect.
+bool checkTrackerHeaders(csvtools::LineSource &lines) {
+    static const auto FIELDS_IN_TRACKER_DATA = TRACKER_HEADERS.size();
+    csvtools::StringRef headerLine;
+    lines.getLine(headerLine);
+    auto trackerHeaders =
+        csvtools::getFields(headerLine, FIELDS_IN_TRACKER_DATA);
+    if (trackerHeaders.size() != FIELDS_IN_TRACKER_DATA) {
+        std::cerr << "Couldn't get " << FIELDS_IN_TRACKER_DATA
+                  << " headings from the first line of the tracker data file."
+                  << std::endl;
+        return false;
+    }
+
+    csvtools::stripQuotes(trackerHeaders);
 #if 0
-        for (auto &header : trackerHeaders) {
-            std::cout << "Header: " << header << std::endl;
-        }
+    for (auto &header : trackerHeaders) {
+        std::cout << "Header: " << header << std::endl;
+    }
 #endif
-        for (std::size_t i = 0; i < FIELDS_IN_TRACKER_DATA; ++i) {
-            if (trackerHeaders[i] != TRACKER_HEADERS[i]) {
-                std::cerr << "Heading mismatch in tracker data file, column "
-                          << i << ", expected " << TRACKER_HEADERS[i]
-                          << ", found " << trackerHeaders[i] << std::endl;
-                return errorExitAfterUsagePrint();
-            }
+    for (std::size_t i = 0; i < FIELDS_IN_TRACKER_DATA; ++i) {
+        if (trackerHeaders[i] != TRACKER_HEADERS[i]) {
+            std::cerr << "Heading mismatch in tracker data file, column " << i
+                      << ", expected " << TRACKER_HEADERS[i] << ", found "
+                      << trackerHeaders[i] << std::endl;
+            return false;
         }
     }
+    return true;
+}
 
-    std::ifstream timeRefData(argv[2]);
-    if (!timeRefData) {
-        std::cerr << "Could not open time reference data file " << argv[2]
+/// The "convert" subcommand: parse a tracker CSV once into the binary
+/// columnar format.
+int convertTracker(int argc, char *argv[]) {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " convert <tracker data CSV> <binary tracker output>"
+                  << std::endl;
+        return -1;
+    }
+    csvtools::MappedFile csv(argv[2]);
+    if (!csv) {
+        std::cerr << "Could not open tracker data file " << argv[2]
                   << std::endl;
+        return -1;
+    }
+    /// Every line but the header could be a sample.
+    auto lines = static_cast<std::uint64_t>(
+        std::count(csv.data(), csv.data() + csv.size(), '\n'));
+    if (csv.size() > 0 && csv.data()[csv.size() - 1] != '\n') {
+        lines++;
+    }
+    csvtools::MappedLineSource csvLines(csv);
+    if (!checkTrackerHeaders(csvLines)) {
+        return -1;
+    }
+    CSVTrackerSource source(csvLines);
+    binary_tracker::Writer writer(argv[3], lines > 0 ? lines - 1 : 0);
+    if (!writer) {
+        std::cerr << "Could not open output file " << argv[3] << std::endl;
+        return -1;
+    }
+    Nanoseconds t = 0;
+    Eigen::Vector3d xlate;
+    Eigen::Quaterniond rot;
+    /// Start of the line being read, which is where it stopped once it has.
+    auto stoppedAt = csvLines.position();
+    while (source.readPose(t, xlate, rot)) {
+        writer.append(t, xlate, rot);
+        stoppedAt = csvLines.position();
+    }
+    /// Only blank lines may follow the last sample. Otherwise the output is
+    /// left without its header, so a capture cut short there can't be
+    /// loaded and reused as if it were whole.
+    auto isBlank = [](char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    };
+    if (!std::all_of(csv.data() + stoppedAt, csv.data() + csv.size(),
+                     isBlank)) {
+        std::cerr << "Stopped at line " << writer.sampleCount() + 2
+                  << ", which isn't a tracker sample: only the "
+                  << writer.sampleCount() << " samples before it were "
+                  << "converted." << std::endl;
+        return -1;
+    }
+    if (!writer.finish()) {
+        std::cerr << "Error writing output file " << argv[3] << std::endl;
+        return -1;
+    }
+    std::cerr << "Converted " << writer.sampleCount() << " tracker samples."
+              << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "convert") {
+        return convertTracker(argc, argv);
+    }
+    instrument::start();
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        return errorExitAfterUsagePrint();
+    }
+    // Opened first, so a writer opening the inputs in the other order when
+    // streaming isn't left waiting while we wait for the tracker header.
+    InputFile timeRefData;
+    if (!openInput(opts.timeRefFn, opts, timeRefData)) {
+        std::cerr << "Could not open time reference data file "
+                  << opts.timeRefFn << std::endl;
         return errorExitAfterUsagePrint();
     }
+    InputFile trackerData;
+
+    binary_tracker::File binaryTrackerFile;
+    std::unique_ptr<TrackerSource> trackerSource;
+    // Streams can't be looked at before being read: they're always CSV.
+    const bool binaryTracker =
+        !opts.stream && binary_tracker::isBinaryTrackerFile(opts.trackerFn);
+    if (binaryTracker) {
+        std::string error;
+        if (!binaryTrackerFile.open(opts.trackerFn, error, opts.mapHints)) {
+            std::cerr << "Could not read binary tracker data file "
+                      << opts.trackerFn << ": " << error << std::endl;
+            return errorExitAfterUsagePrint();
+        }
+        trackerSource.reset(new BinaryTrackerSource(binaryTrackerFile));
+    } else {
+        if (!openInput(opts.trackerFn, opts, trackerData)) {
+            std::cerr << "Could not open tracker data file " << opts.trackerFn
+                      << std::endl;
+            return errorExitAfterUsagePrint();
+        }
+        if (!checkTrackerHeaders(*trackerData.lines)) {
+            return errorExitAfterUsagePrint();
+        }
+        trackerSource.reset(new CSVTrackerSource(*trackerData.lines));
+    }
+
     // Verify the first line of the other file to look for at least sec,usec
     // headers.
-    static const auto dataHeaderLine = csvtools::getCleanLine(timeRefData);
+    std::string dataHeaderLine;
+    {
+        csvtools::StringRef headerLine;
+        timeRefData.lines->getLine(headerLine);
+        dataHeaderLine = headerLine.str();
+    }
     {
         auto timestampHeaders =
             csvtools::getFields(dataHeaderLine, NUM_TIMESTAMP_FIELDS);
@@ -339,83 +1097,106 @@ int main(int argc, char *argv[]) {
     }
 
     try {
-        MotionSynthesizer app(trackerData);
-        std::istringstream iss;
-        Eigen::Vector3d xlate;
-        Eigen::Quaterniond rot;
-        bool done = false;
-        std::uint64_t rows = 0;
-        std::ofstream output("outData.csv");
+        csvtools::BufferedWriter output("outData.csv", opts.outputBufferSize);
         if (!output) {
             std::cerr << "Couldn't open the output data file." << std::endl;
         }
 
         /// Write a header line with our extra fields at the beginning.
-        for (auto &field :
-             {"refx", "refy", "refz", "refqw", "refqx", "refqy", "refqz"}) {
-            output << DOUBLEQUOTE_CHAR << field << DOUBLEQUOTE_CHAR
-                   << COMMA_CHAR;
-        }
-        output << dataHeaderLine << COMMA_CHAR;
-        output << std::endl;
-
-        bool startedWriting = false;
-        do {
-            auto data = csvtools::getCleanLine(timeRefData);
-            if (!timeRefData) {
-                std::cerr << "Out of time ref data, all done." << std::endl;
-                std::cerr << "Rows: " << rows << std::endl;
-                break;
-            }
+        std::vector<const char *> fields = {"refx",  "refy",  "refz", "refqw",
+                                            "refqx", "refqy", "refqz"};
+        if (opts.extrapolation.maxHorizon > 0) {
+            fields.push_back("extrapolated");
+        }
+        for (auto field : fields) {
+            output.put(DOUBLEQUOTE_CHAR);
+            output.write(field, std::strlen(field));
+            output.put(DOUBLEQUOTE_CHAR);
+            output.put(COMMA_CHAR);
+        }
+        output.write(dataHeaderLine);
+        output.put(COMMA_CHAR);
+        output.put('\n');
 
-            auto timestampFields =
-                csvtools::getFields(data, NUM_TIMESTAMP_FIELDS);
-            if (timestampFields.size() != NUM_TIMESTAMP_FIELDS) {
-                std::cerr << "Got only " << timestampFields.size()
-                          << " fields, wanted " << NUM_TIMESTAMP_FIELDS
-                          << std::endl;
-                std::cerr << "Line was '" << data << "'" << std::endl;
-                std::cerr << "Rows: " << rows << std::endl;
-                break;
-            }
-            rows++;
-            TimeValue tv;
-            iss.clear();
-            iss.str(timestampFields[0]);
-            iss >> tv.seconds;
-            iss.clear();
-            iss.str(timestampFields[1]);
-            iss >> tv.microseconds;
-            switch (app(tv, xlate, rot)) {
-            case Status::BeforeRecordedTrackerData:
-                std::cout << tv << " not in [ " << app.getStartTime() << " , "
-                          << app.getEndTime() << " ]" << std::endl;
-                // std::cout << "Skip!" << std::endl;
-                break;
-            case Status::Successful:
-                if (!startedWriting) {
-                    std::cout << "Starting to write data rows!" << std::endl;
-                    startedWriting = true;
+        if (opts.workers > 0) {
+            auto const &ref = timeRefData.mapping;
+            auto refBody =
+                csvtools::lineStartAtOrAfter(ref.data(), ref.size(), 1);
+            if (opts.randomAccess) {
+                TrackerStore store;
+                loadTrackerStore(store, *trackerSource, trackerData, opts);
+                RandomAccessChunkRunner runner = {store};
+                processReferenceChunks(runner, ref.data(), refBody,
+                                       ref.size(), output, opts);
+            } else {
+                SequentialChunkRunner runner;
+                runner.rotationPolicy = opts.rotationPolicy;
+                runner.extrapolation = opts.extrapolation;
+                if (binaryTracker) {
+                    runner.openTracker = [&] {
+                        return std::unique_ptr<TrackerSource>(
+                            new BinaryTrackerSource(binaryTrackerFile));
+                    };
+                } else {
+                    /// By value: only called once this block is done.
+                    const auto data = trackerData.mapping.data();
+                    const auto size = trackerData.mapping.size();
+                    const auto trackerBody =
+                        csvtools::lineStartAtOrAfter(data, size, 1);
+                    runner.openTracker = [data, size, trackerBody] {
+                        return std::unique_ptr<TrackerSource>(
+                            new MappedCSVTrackerSource(data, size,
+                                                       trackerBody));
+                    };
+                }
+                if (opts.skipAhead) {
+                    refBody = skipReferenceRows(
+                        ref, refBody,
+                        MotionSynthesizer(*trackerSource).getStartTime());
                 }
-                output << xlate.x() << COMMA_CHAR << xlate.y() << COMMA_CHAR
-                       << xlate.z() << COMMA_CHAR << rot.w() << COMMA_CHAR
-                       << rot.x() << COMMA_CHAR << rot.y() << COMMA_CHAR
-                       << rot.z() << COMMA_CHAR << data << std::endl;
-                // std::cout << xlate.transpose() << std::endl;
-                break;
-            case Status::OutOfData:
-                std::cout << "Out of data from the tracker." << std::endl;
-                done = true;
-                break;
-            default:
-                std::cerr << "Bad things happened!" << std::endl;
-                break;
+                processReferenceChunks(runner, ref.data(), refBody,
+                                       ref.size(), output, opts);
+                std::cerr << "Rotation intervals: " << runner.slerpIntervals
+                          << " by slerp, " << runner.nlerpIntervals
+                          << " by nlerp." << std::endl;
             }
-        } while (!done);
+        } else if (opts.stream) {
+            MotionSynthesizer app(*trackerSource, opts.rotationPolicy);
+            app.setExtrapolation(opts.extrapolation);
+            processReferenceRowsLive(app, *timeRefData.liveLines,
+                                     *trackerData.liveLines, output, opts);
+            reportLiveEnd("tracker data", *trackerData.liveLines, opts);
+            reportLiveEnd("time reference data", *timeRefData.liveLines, opts);
+            std::cerr << "Rotation intervals: " << app.slerpIntervals()
+                      << " by slerp, " << app.nlerpIntervals() << " by nlerp."
+                      << std::endl;
+        } else if (opts.randomAccess) {
+            TrackerStore store;
+            loadTrackerStore(store, *trackerSource, trackerData, opts);
+            RandomAccessInterpolator app(store);
+            interpolateReferenceRows(app, *timeRefData.lines, output, opts);
+        } else {
+            MotionSynthesizer app(*trackerSource, opts.rotationPolicy);
+            app.setExtrapolation(opts.extrapolation);
+            if (opts.skipAhead) {
+                skipReferenceRows(timeRefData, app.getStartTime());
+            }
+            interpolateReferenceRows(app, *timeRefData.lines, output, opts);
+            std::cerr << "Rotation intervals: " << app.slerpIntervals()
+                      << " by slerp, " << app.nlerpIntervals() << " by nlerp."
+                      << std::endl;
+        }
+        output.flush();
+        std::cerr << "Output: " << output.bytesWritten() << " bytes in "
+                  << output.flushCount() << " writes." << std::endl;
+        if (!output) {
+            std::cerr << "Error writing the output data file." << std::endl;
+        }
     } catch (std::exception const &e) {
         std::cerr << "Got exception: " << e.what() << std::endl;
         return -2;
     }
 
+    instrument::printSummary(std::cerr);
     return 0;
 }